@@ -0,0 +1,300 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursoranchors.h"
+#include "multicursortracer.h"
+
+#include <KTextEditor/Document>
+
+#include <QHash>
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+const uint hash_base = 31;
+
+std::vector<uint> lineHashes(KTextEditor::Document * doc)
+{
+  std::vector<uint> hashes(doc->lines());
+  for (int line = 0; line < int(hashes.size()); ++line) {
+    hashes[line] = qHash(doc->line(line));
+  }
+  return hashes;
+}
+
+uint hashText(const QChar * s, int n)
+{
+  uint h = 0;
+  for (int i = 0; i < n; ++i) {
+    h = h * hash_base + s[i].unicode();
+  }
+  return h;
+}
+}
+
+void MultiCursorAnchors::clear()
+{
+  m_lines.clear();
+  m_cursors.clear();
+  m_ranges.clear();
+}
+
+MultiCursorAnchors::Anchor MultiCursorAnchors::anchor(
+  QString const & text, KTextEditor::Cursor const & c)
+{
+  const int column = qMin(c.column(), text.size());
+  Anchor a;
+  a.line = c.line();
+  a.column = column;
+  a.before = qMin(context_size, column);
+  a.length = a.before + qMin(context_size, text.size() - column);
+  a.hash = hashText(text.unicode() + column - a.before, a.length);
+  return a;
+}
+
+void MultiCursorAnchors::capture(
+  KTextEditor::Document * doc
+, std::vector<KTextEditor::Cursor> const & cursors
+, std::vector<KTextEditor::Range> const & ranges)
+{
+  MULTICURSOR_TRACE_FUNCTION("reload");
+  m_lines = lineHashes(doc);
+
+  // positions are sorted, a line is read once
+  int line = -1;
+  QString text;
+  auto line_of = [&](int l) -> QString const & {
+    if (l != line) {
+      line = l;
+      text = doc->line(l);
+    }
+    return text;
+  };
+
+  m_cursors.clear();
+  m_cursors.reserve(cursors.size());
+  for (KTextEditor::Cursor const & c : cursors) {
+    m_cursors.push_back(anchor(line_of(c.line()), c));
+  }
+  m_ranges.clear();
+  m_ranges.reserve(ranges.size() * 2);
+  for (KTextEditor::Range const & r : ranges) {
+    m_ranges.push_back(anchor(line_of(r.start().line()), r.start()));
+    m_ranges.push_back(anchor(line_of(r.end().line()), r.end()));
+  }
+}
+
+bool MultiCursorAnchors::find(
+  QString const & text, Anchor const & a, int line
+, KTextEditor::Cursor & found)
+{
+  if (a.length > text.size()) {
+    return false;
+  }
+
+  const QChar * s = text.unicode();
+  // the same column first
+  const int start = a.column - a.before;
+  if (start + a.length <= text.size()
+   && hashText(s + start, a.length) == a.hash) {
+    found = KTextEditor::Cursor(line, a.column);
+    return true;
+  }
+
+  // Rabin-Karp, the nearest match of the old column
+  uint power = 1;
+  for (int i = 0; i < a.length; ++i) {
+    power *= hash_base;
+  }
+  uint h = hashText(s, a.length);
+  int best = -1;
+  for (int i = 0; ; ++i) {
+    if (h == a.hash) {
+      const int column = i + a.before;
+      if (best == -1 || qAbs(column - a.column) < qAbs(best - a.column)) {
+        best = column;
+      }
+      else {
+        break;
+      }
+    }
+    if (i + a.length >= text.size()) {
+      break;
+    }
+    h = h * hash_base + s[i + a.length].unicode() - power * s[i].unicode();
+  }
+  if (best == -1) {
+    return false;
+  }
+  found = KTextEditor::Cursor(line, best);
+  return true;
+}
+
+void MultiCursorAnchors::relocate(
+  KTextEditor::Document * doc
+, std::vector<KTextEditor::Cursor> & cursors
+, std::vector<KTextEditor::Range> & ranges) const
+{
+  MULTICURSOR_TRACE_FUNCTION("reload");
+  const std::vector<int> lines = matchLines(m_lines, lineHashes(doc));
+
+  auto relocate = [&](Anchor const & a, KTextEditor::Cursor & found) {
+    if (a.line >= int(lines.size()) || lines[a.line] == -1) {
+      return false;
+    }
+    const int line = lines[a.line];
+    return find(doc->line(line), a, line, found);
+  };
+
+  cursors.clear();
+  KTextEditor::Cursor c;
+  for (Anchor const & a : m_cursors) {
+    if (relocate(a, c)) {
+      cursors.push_back(c);
+    }
+  }
+  std::sort(cursors.begin(), cursors.end());
+  cursors.erase(std::unique(cursors.begin(), cursors.end()), cursors.end());
+
+  ranges.clear();
+  KTextEditor::Cursor start;
+  KTextEditor::Cursor end;
+  for (std::size_t i = 0; i < m_ranges.size(); i += 2) {
+    if (relocate(m_ranges[i], start) && relocate(m_ranges[i+1], end)
+     && start <= end) {
+      ranges.push_back(KTextEditor::Range(start, end));
+    }
+  }
+  std::sort(ranges.begin(), ranges.end()
+  , [](KTextEditor::Range const & a, KTextEditor::Range const & b) {
+      return a.start() < b.start();
+    }
+  );
+  // moved lines can overlap the selections
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    if (n && ranges[i].start() < ranges[n-1].end()) {
+      if (ranges[n-1].end() < ranges[i].end()) {
+        ranges[n-1].setRange(ranges[n-1].start(), ranges[i].end());
+      }
+    }
+    else {
+      ranges[n++] = ranges[i];
+    }
+  }
+  ranges.resize(n);
+}
+
+std::vector<int> MultiCursorAnchors::matchLines(
+  std::vector<uint> const & old_lines, std::vector<uint> const & new_lines)
+{
+  MULTICURSOR_TRACE_FUNCTION("reload");
+  const int old_size = int(old_lines.size());
+  const int new_size = int(new_lines.size());
+  std::vector<int> lines(old_size, -1);
+
+  // common prefix and suffix
+  int prefix = 0;
+  while (prefix < old_size && prefix < new_size
+      && old_lines[prefix] == new_lines[prefix]) {
+    lines[prefix] = prefix;
+    ++prefix;
+  }
+  int suffix = 0;
+  while (suffix < old_size - prefix && suffix < new_size - prefix
+      && old_lines[old_size - 1 - suffix] == new_lines[new_size - 1 - suffix]) {
+    lines[old_size - 1 - suffix] = new_size - 1 - suffix;
+    ++suffix;
+  }
+
+  // lines unique in both sides
+  struct Count
+  {
+    int old_count = 0;
+    int old_line = 0;
+    int new_count = 0;
+    int new_line = 0;
+  };
+  std::unordered_map<uint, Count> counts;
+  counts.reserve(old_size - prefix - suffix);
+  for (int i = prefix; i < old_size - suffix; ++i) {
+    Count & c = counts[old_lines[i]];
+    ++c.old_count;
+    c.old_line = i;
+  }
+  for (int i = prefix; i < new_size - suffix; ++i) {
+    auto it = counts.find(new_lines[i]);
+    if (it != counts.end()) {
+      ++it->second.new_count;
+      it->second.new_line = i;
+    }
+  }
+  std::vector<std::pair<int, int>> pairs;
+  for (int i = prefix; i < old_size - suffix; ++i) {
+    Count const & c = counts[old_lines[i]];
+    if (c.old_count == 1 && c.new_count == 1) {
+      pairs.push_back(std::make_pair(i, c.new_line));
+    }
+  }
+
+  // longest increasing subsequence of the new lines (patience sorting)
+  std::vector<int> tails;
+  std::vector<int> previous(pairs.size(), -1);
+  for (int i = 0; i < int(pairs.size()); ++i) {
+    auto it = std::lower_bound(tails.begin(), tails.end(), pairs[i].second
+    , [&pairs](int k, int line) { return pairs[k].second < line; });
+    if (it != tails.begin()) {
+      previous[i] = *(it - 1);
+    }
+    if (it == tails.end()) {
+      tails.push_back(i);
+    }
+    else {
+      *it = i;
+    }
+  }
+  std::vector<std::pair<int, int>> anchors;
+  anchors.push_back(std::make_pair(prefix - 1, prefix - 1));
+  const std::size_t first_anchor = anchors.size();
+  for (int k = tails.empty() ? -1 : tails.back(); k != -1; k = previous[k]) {
+    anchors.push_back(pairs[k]);
+  }
+  std::reverse(anchors.begin() + first_anchor, anchors.end());
+  anchors.push_back(std::make_pair(old_size - suffix, new_size - suffix));
+
+  // the identical lines around the anchors
+  for (std::size_t i = 0; i + 1 < anchors.size(); ++i) {
+    int o = anchors[i].first;
+    int n = anchors[i].second;
+    if (o >= 0) {
+      lines[o] = n;
+    }
+    const int o_end = anchors[i+1].first;
+    const int n_end = anchors[i+1].second;
+    while (o + 1 < o_end && n + 1 < n_end && old_lines[o+1] == new_lines[n+1]) {
+      lines[++o] = ++n;
+    }
+    int ob = o_end;
+    int nb = n_end;
+    while (ob - 1 > o && nb - 1 > n && old_lines[ob-1] == new_lines[nb-1]) {
+      lines[--ob] = --nb;
+    }
+  }
+  return lines;
+}
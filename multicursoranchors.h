@@ -0,0 +1,85 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_ANCHORS_H
+#define MULTICURSOR_ANCHORS_H
+
+#include <vector>
+
+#include <KTextEditor/Range>
+
+namespace KTextEditor
+{
+  class Document;
+}
+
+/**
+ * Positions anchored to the content, for a reload of the document.
+ * The lines are matched by their hash (unique lines first, as a patience
+ * diff), then a position is searched on its new line with a rolling hash
+ * of its surrounding text.
+ */
+class MultiCursorAnchors
+{
+public:
+  /// characters kept on each side of a position
+  static const int context_size = 8;
+
+  void capture(
+    KTextEditor::Document * doc
+  , std::vector<KTextEditor::Cursor> const & cursors
+  , std::vector<KTextEditor::Range> const & ranges);
+
+  /// Positions found in the new content (sorted), the others are dropped.
+  void relocate(
+    KTextEditor::Document * doc
+  , std::vector<KTextEditor::Cursor> & cursors
+  , std::vector<KTextEditor::Range> & ranges) const;
+
+  bool isEmpty() const
+  { return m_cursors.empty() && m_ranges.empty(); }
+
+  void clear();
+
+  /// new line of each old line, -1 when removed
+  static std::vector<int> matchLines(
+    std::vector<uint> const & old_lines, std::vector<uint> const & new_lines);
+
+private:
+  struct Anchor
+  {
+    int line;
+    int column;
+    /// the context is [column - before, column - before + length)
+    int before;
+    int length;
+    uint hash;
+  };
+
+  static Anchor anchor(QString const & text, KTextEditor::Cursor const & c);
+  static bool find(
+    QString const & text, Anchor const & anchor, int line
+  , KTextEditor::Cursor & found);
+
+  std::vector<uint> m_lines;
+  std::vector<Anchor> m_cursors;
+  /// start then end
+  std::vector<Anchor> m_ranges;
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursorcodec.h"
+#include "multicursortracer.h"
+
+namespace {
+inline char * writeVarint(char * out, quint32 x)
+{
+  while (x >= 0x80) {
+    *out++ = char(x | 0x80);
+    x >>= 7;
+  }
+  *out++ = char(x);
+  return out;
+}
+
+inline quint32 readVarint(const uchar *& p, const uchar * end)
+{
+  quint32 x = 0;
+  int shift = 0;
+  while (p != end && shift < 35) {
+    const uchar b = *p++;
+    x |= quint32(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      break;
+    }
+    shift += 7;
+  }
+  return x;
+}
+
+inline char * writePosition(
+  char * out
+, KTextEditor::Cursor const & previous
+, KTextEditor::Cursor const & cursor
+) {
+  const int line_delta = cursor.line() - previous.line();
+  out = writeVarint(out, quint32(line_delta));
+  return writeVarint(out, quint32(
+    line_delta ? cursor.column() : cursor.column() - previous.column()));
+}
+
+inline KTextEditor::Cursor readPosition(
+  const uchar *& p, const uchar * end, KTextEditor::Cursor const & previous)
+{
+  const int line_delta = int(readVarint(p, end));
+  const int column = int(readVarint(p, end));
+  return line_delta
+    ? KTextEditor::Cursor(previous.line() + line_delta, column)
+    : KTextEditor::Cursor(previous.line(), previous.column() + column);
+}
+}
+
+QByteArray MultiCursorCodec::encode(
+  std::vector<KTextEditor::Cursor> const & cursors)
+{
+  MULTICURSOR_TRACE("encodeCursors", "codec");
+  QByteArray data;
+  data.resize(int(cursors.size()) * max_position_size);
+  char * out = data.data();
+  KTextEditor::Cursor previous(0, 0);
+  for (KTextEditor::Cursor const & cursor : cursors) {
+    out = writePosition(out, previous, cursor);
+    previous = cursor;
+  }
+  data.resize(int(out - data.constData()));
+  data.squeeze();
+  return data;
+}
+
+QByteArray MultiCursorCodec::encode(
+  std::vector<KTextEditor::Range> const & ranges)
+{
+  MULTICURSOR_TRACE("encodeRanges", "codec");
+  QByteArray data;
+  data.resize(int(ranges.size()) * max_position_size * 2);
+  char * out = data.data();
+  KTextEditor::Cursor previous(0, 0);
+  for (KTextEditor::Range const & range : ranges) {
+    out = writePosition(out, previous, range.start());
+    out = writePosition(out, range.start(), range.end());
+    previous = range.end();
+  }
+  data.resize(int(out - data.constData()));
+  data.squeeze();
+  return data;
+}
+
+void MultiCursorCodec::decode(
+  const char * data, std::size_t size
+, std::vector<KTextEditor::Cursor> & cursors)
+{
+  MULTICURSOR_TRACE("decodeCursors", "codec");
+  const uchar * p = reinterpret_cast<const uchar*>(data);
+  const uchar * end = p + size;
+  // at least 2 bytes by cursor
+  cursors.reserve(cursors.size() + size / 2);
+  KTextEditor::Cursor previous(0, 0);
+  while (p != end) {
+    previous = readPosition(p, end, previous);
+    cursors.push_back(previous);
+  }
+}
+
+void MultiCursorCodec::decode(
+  const char * data, std::size_t size
+, std::vector<KTextEditor::Range> & ranges)
+{
+  MULTICURSOR_TRACE("decodeRanges", "codec");
+  const uchar * p = reinterpret_cast<const uchar*>(data);
+  const uchar * end = p + size;
+  ranges.reserve(ranges.size() + size / 4);
+  KTextEditor::Cursor previous(0, 0);
+  while (p != end) {
+    const KTextEditor::Cursor start = readPosition(p, end, previous);
+    previous = readPosition(p, end, start);
+    ranges.push_back(KTextEditor::Range(start, previous));
+  }
+}
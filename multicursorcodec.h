@@ -0,0 +1,87 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_CODEC_H
+#define MULTICURSOR_CODEC_H
+
+#include <vector>
+#include <cstddef>
+
+#include <QByteArray>
+
+#include <KTextEditor/Range>
+
+/**
+ * Compact form of sorted cursors and selections.
+ * A position is two varints: the line delta with the previous position,
+ * then the column (a delta when the line is the same).
+ * A selection is its start relative to the previous end, then its end
+ * relative to its start.
+ */
+class MultiCursorCodec
+{
+public:
+  /// cursors and selections without MovingRange, their positions are
+  /// those of the revision of the document
+  struct PackedSet
+  {
+    qint64 revision = -1;
+    QByteArray cursors;
+    QByteArray ranges;
+
+    std::size_t bytes() const
+    { return std::size_t(cursors.capacity() + ranges.capacity()); }
+  };
+
+  /// changes from a set to another, both parts have the same revision
+  struct PackedDelta
+  {
+    PackedSet added;
+    PackedSet removed;
+
+    qint64 revision() const
+    { return added.revision; }
+
+    std::size_t bytes() const
+    { return added.bytes() + removed.bytes(); }
+  };
+
+  static QByteArray encode(std::vector<KTextEditor::Cursor> const & cursors);
+  static QByteArray encode(std::vector<KTextEditor::Range> const & ranges);
+
+  /// the decoded positions are appended
+  static void decode(
+    const char * data, std::size_t size
+  , std::vector<KTextEditor::Cursor> & cursors);
+  static void decode(
+    const char * data, std::size_t size
+  , std::vector<KTextEditor::Range> & ranges);
+
+  static void decode(
+    QByteArray const & data, std::vector<KTextEditor::Cursor> & cursors)
+  { decode(data.constData(), std::size_t(data.size()), cursors); }
+
+  static void decode(
+    QByteArray const & data, std::vector<KTextEditor::Range> & ranges)
+  { decode(data.constData(), std::size_t(data.size()), ranges); }
+
+  /// a varint is at most 5 bytes
+  static const int max_position_size = 10;
+};
+
+#endif
@@ -96,6 +96,23 @@ MultiCursorConfig::MultiCursorConfig(QWidget *parent, const QVariantList &args)
     i18n("Remove all cursors and selections if Esc is pressed"), this);
   glayout->addWidget(w.active_remove_all_if_esc);
 
+  w.share_between_views = new QCheckBox(
+    i18n("Share cursors and selections between the views of a document"
+         " (for the new views)"), this);
+  glayout->addWidget(w.share_between_views);
+
+  w.persist_cursors = new QCheckBox(
+    i18n("Restore cursors and selections when a document is reopened"), this);
+  glayout->addWidget(w.persist_cursors);
+
+  QHBoxLayout * hlayout = new QHBoxLayout(this);
+  w.active_trace = new QCheckBox(
+    i18n("Write a trace of the editions (Chrome trace format)"), this);
+  w.trace_file = new KLineEdit(this);
+  hlayout->addWidget(w.active_trace);
+  hlayout->addWidget(w.trace_file);
+  glayout->addLayout(hlayout);
+
   setLayout(glayout);
 
   //load();
@@ -133,6 +150,21 @@ MultiCursorConfig::MultiCursorConfig(QWidget *parent, const QVariantList &args)
     w.active_remove_all_if_esc, SIGNAL(stateChanged(int)),
     this, SLOT(slotChanged()));
 
+  QObject::connect(
+    w.share_between_views, SIGNAL(stateChanged(int)),
+    this, SLOT(slotChanged()));
+
+  QObject::connect(
+    w.persist_cursors, SIGNAL(stateChanged(int)),
+    this, SLOT(slotChanged()));
+
+  QObject::connect(
+    w.active_trace, SIGNAL(stateChanged(int)),
+    this, SLOT(slotChanged()));
+  QObject::connect(
+    w.trace_file, SIGNAL(textChanged(QString)),
+    this, SLOT(slotChanged()));
+
 
   QObject::connect(
     w.cursor.underline_style, SIGNAL(currentIndexChanged(int)),
@@ -145,6 +177,10 @@ MultiCursorConfig::MultiCursorConfig(QWidget *parent, const QVariantList &args)
   QObject::connect(
     w.cursor.active_ctrl_click, SIGNAL(toggled(bool)),
     w.cursor.remove_cursor_if_only_click, SLOT(setEnabled(bool)));
+
+  QObject::connect(
+    w.active_trace, SIGNAL(toggled(bool)),
+    w.trace_file, SLOT(setEnabled(bool)));
 }
 
 MultiCursorConfig::~MultiCursorConfig()
@@ -188,6 +224,13 @@ void MultiCursorConfig::save()
 
     self->setActiveRemoveAllIfEsc(w.active_remove_all_if_esc->isChecked());
 
+    self->setShareBetweenViews(w.share_between_views->isChecked());
+
+    self->setPersistCursors(w.persist_cursors->isChecked());
+
+    self->setActiveTrace(
+      w.active_trace->isChecked(), w.trace_file->text());
+
     self->writeConfig();
   }
   else
@@ -219,6 +262,15 @@ void MultiCursorConfig::save()
     cg.writeEntry(
       "active_remove_all_if_esc",
       w.active_remove_all_if_esc->isChecked());
+
+    cg.writeEntry(
+      "share_between_views",
+      w.share_between_views->isChecked());
+
+    cg.writeEntry("persist_cursors", w.persist_cursors->isChecked());
+
+    cg.writeEntry("active_trace", w.active_trace->isChecked());
+    cg.writeEntry("trace_file", w.trace_file->text());
   }
   emit changed(false);
 }
@@ -245,6 +297,13 @@ void MultiCursorConfig::load()
     w.selection.active_ctrl_click->setChecked(self->activeSelectionCtrlClick());
 
     w.active_remove_all_if_esc->setChecked(self->activeRemoveAllIfEsc());
+
+    w.share_between_views->setChecked(self->shareBetweenViews());
+
+    w.persist_cursors->setChecked(self->persistCursors());
+
+    w.active_trace->setChecked(self->activeTrace());
+    w.trace_file->setText(self->traceFile());
   }
   else
   {
@@ -282,6 +341,17 @@ void MultiCursorConfig::load()
     w.active_remove_all_if_esc->setChecked(
       cg.readEntry(
         "active_remove_all_if_esc", values.m_active_remove_all_if_esc));
+
+    w.share_between_views->setChecked(
+      cg.readEntry("share_between_views", values.share_between_views));
+
+    w.persist_cursors->setChecked(
+      cg.readEntry("persist_cursors", values.persist_cursors));
+
+    w.active_trace->setChecked(
+      cg.readEntry("active_trace", values.active_trace));
+    w.trace_file->setText(
+      cg.readEntry("trace_file", MultiCursorPlugin::defaultTraceFile()));
   }
 
   if (!w.cursor.active_ctrl_click->isChecked()) {
@@ -295,6 +365,9 @@ void MultiCursorConfig::load()
     w.selection.underline_color->setEnabled(false);
     w.selection.underline_color_label->setEnabled(false);
   }
+  if (!w.active_trace->isChecked()) {
+    w.trace_file->setEnabled(false);
+  }
 
   emit changed(false);
 }
@@ -321,6 +394,13 @@ void MultiCursorConfig::defaults()
 
   w.active_remove_all_if_esc->setChecked(values.m_active_remove_all_if_esc);
 
+  w.share_between_views->setChecked(values.share_between_views);
+
+  w.persist_cursors->setChecked(values.persist_cursors);
+
+  w.active_trace->setChecked(values.active_trace);
+  w.trace_file->setText(MultiCursorPlugin::defaultTraceFile());
+
   emit changed(true);
 }
 
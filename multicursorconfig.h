@@ -22,6 +22,7 @@
 
 class KColorButton;
 class KComboBox;
+class KLineEdit;
 class QCheckBox;
 class QLabel;
 
@@ -62,6 +63,11 @@ private:
     } selection;
 
     QCheckBox * active_remove_all_if_esc;
+    QCheckBox * share_between_views;
+    QCheckBox * persist_cursors;
+
+    QCheckBox * active_trace;
+    KLineEdit * trace_file;
   } w;
 };
 
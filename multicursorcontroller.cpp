@@ -0,0 +1,80 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursorcontroller.h"
+#include "multicursortracer.h"
+
+KTextEditor::View * MultiCursorController::view() const
+{
+  return m_view ? m_view->view() : nullptr;
+}
+
+std::size_t MultiCursorController::setCursors(
+  const KTextEditor::Cursor * cursors, std::size_t size, Mode mode)
+{
+  MULTICURSOR_TRACE_FUNCTION("controller");
+  if (!m_view) {
+    return 0;
+  }
+  m_view->applyCursors(
+    std::vector<KTextEditor::Cursor>(cursors, cursors + size)
+  , MultiCursorView::BatchMode(mode));
+  return cursorCount();
+}
+
+std::size_t MultiCursorController::setRanges(
+  const KTextEditor::Range * ranges, std::size_t size, Mode mode)
+{
+  MULTICURSOR_TRACE_FUNCTION("controller");
+  if (!m_view) {
+    return 0;
+  }
+  m_view->applyRanges(
+    std::vector<KTextEditor::Range>(ranges, ranges + size)
+  , MultiCursorView::BatchMode(mode));
+  return rangeCount();
+}
+
+void MultiCursorController::clear()
+{
+  MULTICURSOR_TRACE_FUNCTION("controller");
+  if (m_view) {
+    m_view->applyCursors(std::vector<KTextEditor::Cursor>(), MultiCursorView::BatchReplace);
+    m_view->applyRanges(std::vector<KTextEditor::Range>(), MultiCursorView::BatchReplace);
+  }
+}
+
+std::vector<KTextEditor::Cursor> MultiCursorController::cursors() const
+{
+  return m_view ? m_view->cursorPositions() : std::vector<KTextEditor::Cursor>();
+}
+
+std::vector<KTextEditor::Range> MultiCursorController::ranges() const
+{
+  return m_view ? m_view->rangePositions() : std::vector<KTextEditor::Range>();
+}
+
+std::size_t MultiCursorController::cursorCount() const
+{
+  return m_view ? m_view->cursorCount() : 0;
+}
+
+std::size_t MultiCursorController::rangeCount() const
+{
+  return m_view ? m_view->rangeCount() : 0;
+}
@@ -0,0 +1,85 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_CONTROLLER_H
+#define MULTICURSOR_CONTROLLER_H
+
+#include <vector>
+#include <cstddef>
+
+#include <QPointer>
+
+#include <KTextEditor/Range>
+
+#include "multicursorview.h"
+
+/**
+ * Handle on the virtual cursors and selections of a view, returned by
+ * MultiCursorPlugin::controller(). Positions are given as spans (pointer
+ * and size), need not be sorted and are applied in one batch: no signal or
+ * action by position, one undo step of the virtual cursors.
+ * The handle becomes invalid when the view is closed.
+ */
+class MultiCursorController
+{
+public:
+  enum Mode
+  {
+    Add = MultiCursorView::BatchAdd,
+    Replace = MultiCursorView::BatchReplace,
+    Remove = MultiCursorView::BatchRemove
+  };
+
+  explicit MultiCursorController(MultiCursorView * view = nullptr)
+  : m_view(view)
+  {}
+
+  bool isValid() const
+  { return m_view; }
+
+  KTextEditor::View * view() const;
+
+  /// number of cursors after the operation
+  std::size_t setCursors(
+    const KTextEditor::Cursor * cursors, std::size_t size, Mode mode = Add);
+  std::size_t setCursors(
+    std::vector<KTextEditor::Cursor> const & cursors, Mode mode = Add)
+  { return setCursors(cursors.data(), cursors.size(), mode); }
+
+  /// number of selections after the operation, overlapping selections are
+  /// merged
+  std::size_t setRanges(
+    const KTextEditor::Range * ranges, std::size_t size, Mode mode = Add);
+  std::size_t setRanges(
+    std::vector<KTextEditor::Range> const & ranges, Mode mode = Add)
+  { return setRanges(ranges.data(), ranges.size(), mode); }
+
+  void clear();
+
+  /// sorted positions
+  std::vector<KTextEditor::Cursor> cursors() const;
+  std::vector<KTextEditor::Range> ranges() const;
+
+  std::size_t cursorCount() const;
+  std::size_t rangeCount() const;
+
+private:
+  QPointer<MultiCursorView> m_view;
+};
+
+#endif
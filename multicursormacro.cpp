@@ -0,0 +1,411 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursormacro.h"
+#include "multicursortracer.h"
+
+#include <KTextEditor/Document>
+
+#include <QStringList>
+
+#include <algorithm>
+
+namespace {
+struct Position
+{
+  int line;
+  int column;
+  /// column wanted by the vertical moves, -1 when none
+  int keep_column;
+
+  bool operator==(Position const & other) const
+  { return line == other.line && column == other.column; }
+
+  bool operator<(Position const & other) const
+  { return line < other.line || (line == other.line && column < other.column); }
+};
+
+/// Copy of the lines reachable by the cursors of a group, the steps are
+/// played there and not in the document.
+class Window
+{
+public:
+  Window(KTextEditor::Document * doc, int first, int last)
+  : first(first)
+  {
+    lines.reserve(last - first + 1);
+    for (int line = first; line <= last; ++line) {
+      lines.push_back(doc->line(line));
+    }
+  }
+
+  void apply(MultiCursorMacro::Step const & step)
+  {
+    for (std::size_t i = 0; i < cursors.size(); ++i) {
+      apply(i, step);
+    }
+    // cursors are still sorted, those that meet are merged
+    cursors.erase(std::unique(cursors.begin(), cursors.end()), cursors.end());
+  }
+
+  const int first;
+  std::vector<QString> lines;
+  std::vector<Position> cursors;
+
+private:
+  int length(int line) const
+  { return lines[line].size(); }
+
+  int lastLine() const
+  { return int(lines.size()) - 1; }
+
+  void apply(std::size_t i, MultiCursorMacro::Step const & step)
+  {
+    Position & c = cursors[i];
+    const int keep_column = c.keep_column;
+    c.keep_column = -1;
+
+    switch (step.op) {
+      case MultiCursorMacro::Insert:
+        insert(c, step.text);
+        break;
+      case MultiCursorMacro::Backspace:
+        if (c.column) {
+          remove(Position{c.line, c.column - 1, -1}, c);
+        }
+        else if (c.line) {
+          remove(Position{c.line - 1, length(c.line - 1), -1}, c);
+        }
+        break;
+      case MultiCursorMacro::DeleteNext:
+        if (c.column != length(c.line)) {
+          remove(c, Position{c.line, c.column + 1, -1});
+        }
+        else if (c.line != lastLine()) {
+          remove(c, Position{c.line + 1, 0, -1});
+        }
+        break;
+      case MultiCursorMacro::DeleteWordLeft: {
+        const Position from = wordPrev(c);
+        if (from < c) {
+          remove(from, c);
+        }
+        break;
+      }
+      case MultiCursorMacro::DeleteWordRight: {
+        const Position to = wordNext(c);
+        if (c < to) {
+          remove(c, to);
+        }
+        break;
+      }
+      case MultiCursorMacro::Up:
+      case MultiCursorMacro::Down: {
+        const int line = c.line + (step.op == MultiCursorMacro::Up ? -1 : 1);
+        if (0 <= line && line <= lastLine()) {
+          c.keep_column = (keep_column == -1) ? c.column : keep_column;
+          c.line = line;
+          c.column = qMin(c.keep_column, length(line));
+        }
+        break;
+      }
+      case MultiCursorMacro::Left:
+        if (c.column) {
+          --c.column;
+        }
+        else if (c.line) {
+          --c.line;
+          c.column = length(c.line);
+        }
+        break;
+      case MultiCursorMacro::Right:
+        if (c.column != length(c.line)) {
+          ++c.column;
+        }
+        else if (c.line != lastLine()) {
+          ++c.line;
+          c.column = 0;
+        }
+        break;
+      case MultiCursorMacro::LineStart:
+        c.column = 0;
+        break;
+      case MultiCursorMacro::LineEnd:
+        c.column = length(c.line);
+        break;
+      case MultiCursorMacro::WordLeft:
+        c = wordPrev(c);
+        break;
+      case MultiCursorMacro::WordRight:
+        c = wordNext(c);
+        break;
+    }
+  }
+
+  /// the cursors at or after \a at are moved after the text
+  void insert(Position at, const QString & text)
+  {
+    const QStringList parts = text.split('\n');
+    const int added_lines = parts.size() - 1;
+    QString & line = lines[at.line];
+    const QString tail = line.mid(at.column);
+    line.truncate(at.column);
+    line += parts.first();
+    if (added_lines) {
+      lines.insert(lines.begin() + at.line + 1, parts.begin() + 1, parts.end());
+    }
+    const int last = at.line + added_lines;
+    const int last_column = (added_lines ? 0 : at.column) + parts.last().size();
+    lines[last] += tail;
+
+    for (Position & c : cursors) {
+      if (c.line == at.line && c.column >= at.column) {
+        c.column = last_column + c.column - at.column;
+        c.line = last;
+      }
+      else if (c.line > at.line) {
+        c.line += added_lines;
+      }
+    }
+  }
+
+  /// the cursors inside the range go to its start
+  void remove(Position from, Position to)
+  {
+    const int removed_lines = to.line - from.line;
+    lines[from.line] = lines[from.line].left(from.column)
+      + lines[to.line].mid(to.column);
+    lines.erase(lines.begin() + from.line + 1, lines.begin() + to.line + 1);
+
+    for (Position & c : cursors) {
+      if (c < from) {
+        continue;
+      }
+      if (c < to) {
+        c.line = from.line;
+        c.column = from.column;
+      }
+      else if (c.line == to.line) {
+        c.line = from.line;
+        c.column = from.column + c.column - to.column;
+      }
+      else {
+        c.line -= removed_lines;
+      }
+    }
+  }
+
+  // same rules as the word moves of the virtual cursors
+
+  Position wordPrev(Position c) const
+  {
+    const QString & text = lines[c.line];
+    int column = c.column;
+    while (column && text[column-1].isSpace()) {
+      --column;
+    }
+    if (column == 0) {
+      if (c.line) {
+        return Position{c.line - 1, length(c.line - 1), -1};
+      }
+    }
+    else if (text[column-1].isLetterOrNumber()) {
+      do {
+        --column;
+      } while (column && text[column-1].isLetterOrNumber());
+    }
+    else {
+      do {
+        --column;
+      } while (column
+        && !text[column-1].isLetterOrNumber()
+        && !text[column-1].isSpace()
+      );
+    }
+    return Position{c.line, column, -1};
+  }
+
+  Position wordNext(Position c) const
+  {
+    int line = c.line;
+    int column = c.column;
+    if (column == length(line)) {
+      if (line != lastLine()) {
+        ++line;
+        column = 0;
+      }
+    }
+    else if (lines[line][column].isLetterOrNumber()) {
+      do {
+        ++column;
+      } while (column != length(line) && lines[line][column].isLetterOrNumber());
+    }
+    else {
+      do {
+        ++column;
+      } while (column != length(line)
+        && !lines[line][column].isLetterOrNumber()
+        && !lines[line][column].isSpace()
+      );
+    }
+    while (column != length(line) && lines[line][column].isSpace()) {
+      ++column;
+    }
+    return Position{line, column, -1};
+  }
+};
+
+/// lines that a step can reach above (-1) or below (1) the cursor
+int reach(MultiCursorMacro::Operation op)
+{
+  switch (op) {
+    case MultiCursorMacro::Backspace:
+    case MultiCursorMacro::DeleteWordLeft:
+    case MultiCursorMacro::Up:
+    case MultiCursorMacro::Left:
+    case MultiCursorMacro::WordLeft:
+      return -1;
+    case MultiCursorMacro::DeleteNext:
+    case MultiCursorMacro::DeleteWordRight:
+    case MultiCursorMacro::Down:
+    case MultiCursorMacro::Right:
+    case MultiCursorMacro::WordRight:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/// smallest replacements turning \a old_lines into \a new_lines
+void diff(
+  int first
+, std::vector<QString> const & old_lines
+, std::vector<QString> const & new_lines
+, std::vector<MultiCursorMacro::Edit> & edits)
+{
+  const int old_size = int(old_lines.size());
+  const int new_size = int(new_lines.size());
+
+  if (old_size == new_size) {
+    for (int i = 0; i < old_size; ++i) {
+      QString const & a = old_lines[i];
+      QString const & b = new_lines[i];
+      if (a == b) {
+        continue;
+      }
+      const int n = qMin(a.size(), b.size());
+      int prefix = 0;
+      while (prefix < n && a[prefix] == b[prefix]) {
+        ++prefix;
+      }
+      int suffix = 0;
+      while (suffix < n - prefix
+        && a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix]) {
+        ++suffix;
+      }
+      edits.push_back(MultiCursorMacro::Edit{
+        KTextEditor::Range(first + i, prefix, first + i, a.size() - suffix)
+      , b.mid(prefix, b.size() - prefix - suffix)
+      });
+    }
+    return ;
+  }
+
+  // whole lines, at least one line of each side is kept in the replacement
+  const int n = qMin(old_size, new_size) - 1;
+  int prefix = 0;
+  while (prefix < n && old_lines[prefix] == new_lines[prefix]) {
+    ++prefix;
+  }
+  int suffix = 0;
+  while (suffix < n - prefix
+    && old_lines[old_size - 1 - suffix] == new_lines[new_size - 1 - suffix]) {
+    ++suffix;
+  }
+  QStringList text;
+  for (int i = prefix; i < new_size - suffix; ++i) {
+    text.append(new_lines[i]);
+  }
+  const int last = old_size - 1 - suffix;
+  edits.push_back(MultiCursorMacro::Edit{
+    KTextEditor::Range(first + prefix, 0, first + last, old_lines[last].size())
+  , text.join("\n")
+  });
+}
+}
+
+void MultiCursorMacro::record(Operation op, const QString & text)
+{
+  if (op == Insert && !m_steps.empty() && m_steps.back().op == Insert) {
+    m_steps.back().text += text;
+  }
+  else {
+    m_steps.push_back(Step{op, text});
+  }
+}
+
+MultiCursorMacro::Script MultiCursorMacro::compile(
+  KTextEditor::Document * doc
+, std::vector<KTextEditor::Cursor> const & cursors) const
+{
+  MULTICURSOR_TRACE_FUNCTION("macro");
+  Script script;
+  if (cursors.empty()) {
+    return script;
+  }
+
+  int up = 0;
+  int down = 0;
+  for (Step const & step : m_steps) {
+    const int r = reach(step.op);
+    up += (r < 0);
+    down += (r > 0);
+  }
+
+  // cursors whose reachable lines overlap are played together
+  const int last_line = doc->lines() - 1;
+  int shift = 0;
+  auto it = cursors.begin();
+  while (it != cursors.end()) {
+    const int first = qMax(0, it->line() - up);
+    int last = qMin(last_line, it->line() + down);
+    auto group_end = it + 1;
+    while (group_end != cursors.end() && group_end->line() - up <= last) {
+      last = qMin(last_line, group_end->line() + down);
+      ++group_end;
+    }
+
+    Window window(doc, first, last);
+    const std::vector<QString> old_lines = window.lines;
+    window.cursors.reserve(group_end - it);
+    for (; it != group_end; ++it) {
+      window.cursors.push_back(Position{it->line() - first, it->column(), -1});
+    }
+    for (Step const & step : m_steps) {
+      window.apply(step);
+    }
+
+    diff(first, old_lines, window.lines, script.edits);
+    for (Position const & c : window.cursors) {
+      script.cursors.push_back(KTextEditor::Cursor(first + shift + c.line, c.column));
+    }
+    shift += int(window.lines.size()) - int(old_lines.size());
+  }
+
+  return script;
+}
@@ -0,0 +1,100 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_MACRO_H
+#define MULTICURSOR_MACRO_H
+
+#include <vector>
+
+#include <QString>
+
+#include <KTextEditor/Range>
+
+namespace KTextEditor
+{
+  class Document;
+}
+
+/**
+ * Edits and moves recorded at the real cursor, compiled into edit scripts
+ * for a set of cursors. The document is only read by compile(), the caller
+ * applies the edits in one transaction.
+ */
+class MultiCursorMacro
+{
+public:
+  enum Operation
+  {
+    Insert,
+    Backspace,
+    DeleteNext,
+    DeleteWordLeft,
+    DeleteWordRight,
+    Up,
+    Down,
+    Left,
+    Right,
+    LineStart,
+    LineEnd,
+    WordLeft,
+    WordRight
+  };
+
+  struct Step
+  {
+    Operation op;
+    QString text;
+  };
+
+  /// consecutive insertions are merged
+  void record(Operation op, const QString & text = QString());
+
+  void clear()
+  { m_steps.clear(); }
+
+  bool isEmpty() const
+  { return m_steps.empty(); }
+
+  std::vector<Step> const & steps() const
+  { return m_steps; }
+
+  struct Edit
+  {
+    KTextEditor::Range range;
+    QString text;
+  };
+
+  struct Script
+  {
+    /// sorted and disjoint, in the coordinates of the document before the
+    /// replay: they are applied from the last one
+    std::vector<Edit> edits;
+    /// positions of the cursors after the edits
+    std::vector<KTextEditor::Cursor> cursors;
+  };
+
+  /// \a cursors are sorted
+  Script compile(
+    KTextEditor::Document * doc
+  , std::vector<KTextEditor::Cursor> const & cursors) const;
+
+private:
+  std::vector<Step> m_steps;
+};
+
+#endif
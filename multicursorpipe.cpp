@@ -0,0 +1,213 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursorpipe.h"
+#include "multicursortracer.h"
+
+#include <QStringList>
+#include <QThread>
+
+#include <KLocale>
+
+MultiCursorPipe::MultiCursorPipe(
+  const QString & command, std::vector<QString> inputs, bool is_joined
+, QObject * parent)
+: QObject(parent)
+, m_command(command)
+, m_inputs(std::move(inputs))
+, m_is_joined(is_joined)
+, m_is_done(false)
+, m_next(0)
+, m_max_processes(std::size_t(qMax(1, QThread::idealThreadCount())))
+{
+  m_ends_with_newline.reserve(m_inputs.size());
+  for (QString const & text : m_inputs) {
+    m_ends_with_newline.push_back(text.endsWith('\n'));
+  }
+}
+
+MultiCursorPipe::~MultiCursorPipe()
+{
+  for (auto & running : m_running) {
+    running.first->kill();
+  }
+}
+
+QProcess * MultiCursorPipe::newProcess()
+{
+  QProcess * process = new QProcess(this);
+  connect(process, SIGNAL(finished(int,QProcess::ExitStatus)),
+          this, SLOT(processFinished(int,QProcess::ExitStatus)));
+  connect(process, SIGNAL(error(QProcess::ProcessError)),
+          this, SLOT(processError(QProcess::ProcessError)));
+  return process;
+}
+
+void MultiCursorPipe::start()
+{
+  MULTICURSOR_TRACE_FUNCTION("pipe");
+  if (m_inputs.empty()) {
+    finish();
+    return ;
+  }
+
+  if (m_is_joined) {
+    m_outputs.reserve(m_inputs.size());
+    QProcess * process = newProcess();
+    m_running[process] = 0;
+    connect(process, SIGNAL(bytesWritten(qint64)),
+            this, SLOT(writeJoinedInput()));
+    connect(process, SIGNAL(readyReadStandardOutput()),
+            this, SLOT(readJoinedOutput()));
+    process->start("/bin/sh", QStringList() << "-c" << m_command);
+    writeJoinedInput();
+  }
+  else {
+    m_outputs.resize(m_inputs.size());
+    while (m_next < m_inputs.size() && m_running.size() < m_max_processes) {
+      startNext();
+    }
+  }
+}
+
+void MultiCursorPipe::startNext()
+{
+  MULTICURSOR_TRACE_FUNCTION("pipe");
+  QProcess * process = newProcess();
+  m_running[process] = m_next;
+  process->start("/bin/sh", QStringList() << "-c" << m_command);
+  process->write(m_inputs[m_next].toUtf8());
+  process->closeWriteChannel();
+  // the document keeps the text
+  m_inputs[m_next] = QString();
+  ++m_next;
+}
+
+void MultiCursorPipe::writeJoinedInput()
+{
+  if (m_is_done || m_running.empty() || m_next == m_inputs.size()) {
+    return ;
+  }
+  QProcess * process = m_running.begin()->first;
+  while (m_next < m_inputs.size()
+    && process->bytesToWrite() < max_pending_bytes) {
+    process->write(m_inputs[m_next].toUtf8());
+    process->write("\0", 1);
+    m_inputs[m_next] = QString();
+    ++m_next;
+  }
+  if (m_next == m_inputs.size()) {
+    process->closeWriteChannel();
+  }
+}
+
+void MultiCursorPipe::readJoinedOutput()
+{
+  if (m_is_done || m_running.empty()) {
+    return ;
+  }
+  m_output += m_running.begin()->first->readAllStandardOutput();
+  int first = 0;
+  int nul;
+  while ((nul = m_output.indexOf('\0', first)) != -1) {
+    if (m_outputs.size() < m_inputs.size()) {
+      m_outputs.push_back(decode(m_output.mid(first, nul - first), m_outputs.size()));
+    }
+    else {
+      m_outputs.push_back(QString());
+    }
+    first = nul + 1;
+  }
+  m_output.remove(0, first);
+}
+
+void MultiCursorPipe::processFinished(
+  int exit_code, QProcess::ExitStatus status)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  QProcess * process = qobject_cast<QProcess*>(sender());
+  if (m_is_done || !process) {
+    return ;
+  }
+
+  if (status != QProcess::NormalExit || exit_code) {
+    const QByteArray error = process->readAllStandardError().left(1024);
+    finish(error.isEmpty()
+      ? i18n("The command failed (exit code %1).", exit_code)
+      : QString::fromLocal8Bit(error.constData(), error.size()));
+    return ;
+  }
+
+  if (m_is_joined) {
+    readJoinedOutput();
+    // the last text can miss its NUL
+    if (!m_output.isEmpty() && m_outputs.size() < m_inputs.size()) {
+      m_outputs.push_back(decode(m_output, m_outputs.size()));
+    }
+    m_output.clear();
+    m_running.clear();
+    process->deleteLater();
+    finish(m_outputs.size() == m_inputs.size()
+      ? QString()
+      : i18n("The command returned %1 texts for %2 selections."
+          , int(m_outputs.size()), int(m_inputs.size())));
+    return ;
+  }
+
+  auto it = m_running.find(process);
+  m_outputs[it->second] = decode(process->readAllStandardOutput(), it->second);
+  m_running.erase(it);
+  process->deleteLater();
+
+  if (m_next < m_inputs.size()) {
+    startNext();
+  }
+  else if (m_running.empty()) {
+    finish();
+  }
+}
+
+void MultiCursorPipe::processError(QProcess::ProcessError error)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  // the other errors are followed by finished()
+  if (error == QProcess::FailedToStart && !m_is_done) {
+    finish(i18n("The command cannot be started."));
+  }
+}
+
+void MultiCursorPipe::finish(const QString & error)
+{
+  m_is_done = true;
+  m_error = error;
+  for (auto & running : m_running) {
+    running.first->kill();
+  }
+  emit finished(error.isEmpty());
+}
+
+QString MultiCursorPipe::decode(
+  const QByteArray & output, std::size_t index) const
+{
+  const int size = (!m_ends_with_newline[index] && output.endsWith('\n'))
+    ? output.size() - 1
+    : output.size();
+  return QString::fromUtf8(output.constData(), size);
+}
+
+#include "multicursorpipe.moc"
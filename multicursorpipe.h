@@ -0,0 +1,91 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_PIPE_H
+#define MULTICURSOR_PIPE_H
+
+#include <vector>
+#include <map>
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QProcess>
+
+/**
+ * Runs a shell command on texts: one process by text on a bounded pool,
+ * or one process for all the texts separated by NUL characters (then the
+ * output must have as many texts, also separated by NUL).
+ * The input is written as the process reads it and the output is split as
+ * it comes, the texts are not copied in one buffer.
+ */
+class MultiCursorPipe
+: public QObject
+{
+  Q_OBJECT
+
+public:
+  MultiCursorPipe(
+    const QString & command, std::vector<QString> inputs, bool is_joined
+  , QObject * parent = 0);
+  ~MultiCursorPipe();
+
+  void start();
+
+  /// valid after finished(true)
+  std::vector<QString> const & outputs() const
+  { return m_outputs; }
+
+  QString errorString() const
+  { return m_error; }
+
+  /// bytes waiting for the joined process before writing the next text
+  static const qint64 max_pending_bytes = 1 << 16;
+
+signals:
+  void finished(bool ok);
+
+private slots:
+  void processFinished(int exit_code, QProcess::ExitStatus status);
+  void processError(QProcess::ProcessError error);
+  void writeJoinedInput();
+  void readJoinedOutput();
+
+private:
+  QProcess * newProcess();
+  void startNext();
+  void finish(const QString & error = QString());
+  /// the newline added by most commands is removed when the text had none
+  QString decode(const QByteArray & output, std::size_t index) const;
+
+  QString m_command;
+  std::vector<QString> m_inputs;
+  std::vector<bool> m_ends_with_newline;
+  std::vector<QString> m_outputs;
+  bool m_is_joined;
+  bool m_is_done;
+  /// next text to start (or to write when joined)
+  std::size_t m_next;
+  std::size_t m_max_processes;
+  std::map<QProcess*, std::size_t> m_running;
+  /// output of the joined process not yet split
+  QByteArray m_output;
+  QString m_error;
+};
+
+#endif
@@ -18,8 +18,10 @@
 #include "multicursorview.h"
 #include "multicursorplugin.h"
 #include "multicursorconfig.h"
+#include "multicursortracer.h"
 
 #include <KConfigGroup>
+#include <KStandardDirs>
 #include <KTextEditor/View>
 
 MultiCursorPlugin *MultiCursorPlugin::plugin = 0;
@@ -40,6 +42,9 @@ MultiCursorPlugin::MultiCursorPlugin(QObject *parent, const QVariantList &)
 , m_remove_cursor_if_only_click(false)
 , m_active_selection_ctrl_click(false)
 , m_active_remove_all_if_esc(false)
+, m_share_between_views(false)
+, m_persist_cursors(false)
+, m_active_trace(false)
 {
   plugin = this;
 
@@ -48,13 +53,24 @@ MultiCursorPlugin::MultiCursorPlugin(QObject *parent, const QVariantList &)
 
 MultiCursorPlugin::~MultiCursorPlugin()
 {
+  MultiCursorTracer::stop();
   plugin = nullptr;
 }
 
 void MultiCursorPlugin::addView(KTextEditor::View *view)
 {
+  std::shared_ptr<MultiCursorView::SharedState> shared;
+  if (m_share_between_views) {
+    for (MultiCursorView * v: m_views) {
+      if (v->document() == view->document()) {
+        shared = v->sharedState();
+        break;
+      }
+    }
+  }
+
   MultiCursorView *nview = new MultiCursorView(
-    view, m_cursor_attr, m_selection_attr);
+    view, m_cursor_attr, m_selection_attr, shared);
   if (m_active_cursor_ctrl_click) {
     nview->setActiveCursorCtrlClick(true, m_remove_cursor_if_only_click);
   }
@@ -78,6 +94,83 @@ void MultiCursorPlugin::removeView(KTextEditor::View *view)
   }
 }
 
+MultiCursorController MultiCursorPlugin::controller(KTextEditor::View * view) const
+{
+  for (MultiCursorView * v: m_views) {
+    if (v->view() == view) {
+      return MultiCursorController(v);
+    }
+  }
+  return MultiCursorController();
+}
+
+MultiCursorController MultiCursorPlugin::controller(KTextEditor::Document * doc) const
+{
+  for (MultiCursorView * v: m_views) {
+    if (v->document() == doc) {
+      return MultiCursorController(v);
+    }
+  }
+  return MultiCursorController();
+}
+
+bool MultiCursorPlugin::hasView(KTextEditor::Document * doc) const
+{
+  for (MultiCursorView * v: m_views) {
+    if (v->document() == doc) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void MultiCursorPlugin::storeClosedSession(
+  KTextEditor::Document * doc, MultiCursorCodec::PackedSet const & set)
+{
+  m_closed_sessions[doc] = set;
+}
+
+bool MultiCursorPlugin::takeClosedSession(
+  KTextEditor::Document * doc, MultiCursorCodec::PackedSet & set)
+{
+  auto it = m_closed_sessions.find(doc);
+  if (it == m_closed_sessions.end()) {
+    return false;
+  }
+  set = std::move(it->second);
+  m_closed_sessions.erase(it);
+  return true;
+}
+
+MultiCursorView::MemoryReport MultiCursorPlugin::memoryReport() const
+{
+  MultiCursorView::MemoryReport report;
+  // the views of a document count the same shared state
+  for (MultiCursorView * v: m_views) {
+    if (v->isSharedStateOwner()) {
+      report.current.merge(v->memoryReport().current);
+    }
+  }
+  report.peak = m_memory_peak;
+  report.peak.maximize(report.current);
+  return report;
+}
+
+void MultiCursorPlugin::updateMemoryPeak()
+{
+  m_memory_peak.maximize(memoryReport().current);
+}
+
+void MultiCursorPlugin::setSynchronizedDocument(
+  MultiCursorView * view, bool active
+) {
+  m_synchronized_views.removeAll(view);
+  m_synchronized_views.removeAll(QPointer<MultiCursorView>());
+  if (active) {
+    m_synchronized_views.append(view);
+  }
+}
+
 void MultiCursorPlugin::readConfig()
 {
   KConfigGroup cg(KGlobal::config(), "MultiCursor Plugin");
@@ -103,6 +196,16 @@ void MultiCursorPlugin::readConfig()
   m_active_selection_ctrl_click = cg.readEntry("active_ctrl_click_selection", true);
 
   m_active_remove_all_if_esc = cg.readEntry("active_remove_all_if_esc", false);
+
+  m_share_between_views
+    = cg.readEntry("share_between_views", values.share_between_views);
+
+  m_persist_cursors
+    = cg.readEntry("persist_cursors", values.persist_cursors);
+
+  setActiveTrace(
+    cg.readEntry("active_trace", values.active_trace),
+    cg.readEntry("trace_file", defaultTraceFile()));
 }
 
 void MultiCursorPlugin::writeConfig()
@@ -122,6 +225,13 @@ void MultiCursorPlugin::writeConfig()
   cg.writeEntry("active_ctrl_click_selection", m_active_selection_ctrl_click);
 
   cg.writeEntry("active_remove_all_if_esc", m_active_remove_all_if_esc);
+
+  cg.writeEntry("share_between_views", m_share_between_views);
+
+  cg.writeEntry("persist_cursors", m_persist_cursors);
+
+  cg.writeEntry("active_trace", m_active_trace);
+  cg.writeEntry("trace_file", m_trace_file);
 }
 
 void MultiCursorPlugin::setActiveCursorCtrlClick(
@@ -150,3 +260,24 @@ void MultiCursorPlugin::setActiveRemoveAllIfEsc(bool active)
   }
 }
 
+
+void MultiCursorPlugin::setActiveTrace(bool active, const QString& filename)
+{
+  if (active == m_active_trace && filename == m_trace_file) {
+    return ;
+  }
+  m_active_trace = active;
+  m_trace_file = filename;
+  if (active) {
+    MultiCursorTracer::start(filename);
+  }
+  else {
+    MultiCursorTracer::stop();
+  }
+}
+
+QString MultiCursorPlugin::defaultTraceFile()
+{
+  return KStandardDirs::locateLocal(
+    "data", "ktexteditor_multicursor/trace.json");
+}
@@ -18,20 +18,24 @@
 #ifndef MULTICURSOR_PLUGIN_H
 #define MULTICURSOR_PLUGIN_H
 
+#include <map>
+
 #include <QColor>
+#include <QPointer>
 #include <QTextFormat>
 
 #include <KTextEditor/Plugin>
 #include <KTextEditor/Attribute>
 
+#include "multicursorview.h"
+#include "multicursorcontroller.h"
+
 namespace KTextEditor
 {
   class View;
+  class Document;
 }
 
-class MultiCursorView;
-
-
 class MultiCursorPlugin
 : public KTextEditor::Plugin
 {
@@ -52,6 +56,9 @@ public:
       bool active_ctrl_click = true;
     } selection;
     bool m_active_remove_all_if_esc = false;
+    bool active_trace = false;
+    bool share_between_views = false;
+    bool persist_cursors = false;
   };
 
 public:
@@ -67,6 +74,34 @@ public:
   void readConfig();
   void writeConfig();
 
+  int viewCount() const
+  { return m_views.size(); }
+
+  /// group of documents receiving the same editions, a closed view is null
+  void setSynchronizedDocument(MultiCursorView * view, bool active);
+  QList<QPointer<MultiCursorView>> const & synchronizedDocuments() const
+  { return m_synchronized_views; }
+
+  /// invalid controller when the view is unknown
+  MultiCursorController controller(KTextEditor::View * view) const;
+  /// Controller of the first view of the document, the one that shares its
+  /// cursors with the other views when shareBetweenViews() is true
+  MultiCursorController controller(KTextEditor::Document * doc) const;
+
+  bool hasView(KTextEditor::Document * doc) const;
+
+  /// Positions of the closed views of a document, without shared state.
+  /// They are saved in the session by the last view (revision locked).
+  void storeClosedSession(
+    KTextEditor::Document * doc, MultiCursorCodec::PackedSet const & set);
+  bool takeClosedSession(
+    KTextEditor::Document * doc, MultiCursorCodec::PackedSet & set);
+
+  /// sum of the memory reports of the documents, the peak is the one of the
+  /// sum
+  MultiCursorView::MemoryReport memoryReport() const;
+  void updateMemoryPeak();
+
   virtual void readConfig(KConfig *)
   {}
   virtual void writeConfig(KConfig *)
@@ -92,6 +127,18 @@ public:
 
   void setActiveRemoveAllIfEsc(bool active);
 
+  /// Used for the views opened afterwards
+  void setShareBetweenViews(bool active)
+  { m_share_between_views = active; }
+
+  /// cursors and selections are saved when the document is closed
+  void setPersistCursors(bool active)
+  { m_persist_cursors = active; }
+
+  void setActiveTrace(bool active, const QString& filename);
+
+  static QString defaultTraceFile();
+
   QBrush cursorBrush() const
   { return m_cursor_attr->background(); }
   QTextCharFormat::UnderlineStyle cursorUnderlineStyle() const
@@ -113,16 +160,32 @@ public:
   { return m_active_selection_ctrl_click; }
   bool activeRemoveAllIfEsc() const
   { return m_active_remove_all_if_esc; }
+  bool shareBetweenViews() const
+  { return m_share_between_views; }
+  bool persistCursors() const
+  { return m_persist_cursors; }
+  bool activeTrace() const
+  { return m_active_trace; }
+  QString traceFile() const
+  { return m_trace_file; }
 
 private:
   static MultiCursorPlugin *plugin;
   QList<MultiCursorView*> m_views;
+  QList<QPointer<MultiCursorView>> m_synchronized_views;
   KTextEditor::Attribute::Ptr m_cursor_attr;
   KTextEditor::Attribute::Ptr m_selection_attr;
   bool m_active_cursor_ctrl_click;
   bool m_remove_cursor_if_only_click;
   bool m_active_selection_ctrl_click;
   bool m_active_remove_all_if_esc;
+  bool m_share_between_views;
+  bool m_persist_cursors;
+  bool m_active_trace;
+  QString m_trace_file;
+  MultiCursorView::MemoryUsage m_memory_peak;
+  std::map<KTextEditor::Document*, MultiCursorCodec::PackedSet>
+    m_closed_sessions;
 };
 
 K_PLUGIN_FACTORY_DECLARATION(MultiCursorPluginFactory)
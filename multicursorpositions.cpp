@@ -0,0 +1,215 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursorpositions.h"
+#include "multicursortracer.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QByteArray>
+
+#include <cstring>
+
+namespace {
+struct Entry
+{
+  const char * path;
+  int path_size;
+  int line;
+  int column;
+  int end_line;
+  int end_column;
+  bool is_range;
+};
+
+/// digits at \a p, -1 if none
+int parseNumber(const char *& p, const char * end)
+{
+  if (p == end || *p < '0' || *p > '9') {
+    return -1;
+  }
+  int n = 0;
+  while (p != end && *p >= '0' && *p <= '9' && n < (1 << 26)) {
+    n = n * 10 + (*p++ - '0');
+  }
+  return n;
+}
+
+/// "line:column[-line:column]" at \a p
+bool parsePosition(const char * p, const char * end, Entry & e)
+{
+  e.line = parseNumber(p, end);
+  if (e.line < 0 || p == end || *p != ':') {
+    return false;
+  }
+  ++p;
+  e.column = parseNumber(p, end);
+  if (e.column < 0) {
+    return false;
+  }
+  e.is_range = false;
+  if (p != end && *p == '-') {
+    const char * q = p + 1;
+    e.end_line = parseNumber(q, end);
+    if (e.end_line >= 0 && q != end && *q == ':') {
+      ++q;
+      e.end_column = parseNumber(q, end);
+      e.is_range = e.end_column >= 0;
+    }
+  }
+  return true;
+}
+
+bool parseLine(const char * p, const char * end, Entry & e)
+{
+  // the first ":line:column" ends the path
+  for (const char * colon = p; colon != end; ++colon) {
+    colon = static_cast<const char*>(std::memchr(colon, ':', end - colon));
+    if (!colon) {
+      break;
+    }
+    if (parsePosition(colon + 1, end, e)) {
+      e.path = p;
+      e.path_size = int(colon - p);
+      return true;
+    }
+  }
+  e.path = p;
+  e.path_size = 0;
+  return parsePosition(p, end, e);
+}
+
+/// 1-based to 0-based
+inline int toIndex(int n)
+{
+  return n ? n - 1 : 0;
+}
+}
+
+bool MultiCursorPositions::read(
+  const QString & list_file, const QString & document_file
+, std::vector<KTextEditor::Cursor> & cursors
+, std::vector<KTextEditor::Range> & ranges)
+{
+  MULTICURSOR_TRACE_FUNCTION("positions");
+  QFile file(list_file);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  if (!file.size()) {
+    return true;
+  }
+  const char * data = reinterpret_cast<const char*>(file.map(0, file.size()));
+  if (!data) {
+    return false;
+  }
+
+  const QDir dir = QFileInfo(list_file).absoluteDir();
+  const QString document = QFileInfo(document_file).absoluteFilePath();
+
+  // the entries of a same file follow each other, the path is resolved
+  // once by group
+  QByteArray last_path;
+  bool last_path_is_document = true;
+
+  const char * p = data;
+  const char * end = data + file.size();
+  Entry e;
+  while (p != end) {
+    const char * eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (!eol) {
+      eol = end;
+    }
+    if (parseLine(p, eol, e)) {
+      if (e.path_size != last_path.size()
+       || std::memcmp(e.path, last_path.constData(), e.path_size)) {
+        last_path = QByteArray(e.path, e.path_size);
+        last_path_is_document = last_path.isEmpty()
+          || QDir::cleanPath(dir.absoluteFilePath(
+               QString::fromUtf8(e.path, e.path_size))) == document;
+      }
+      if (last_path_is_document) {
+        const KTextEditor::Cursor start(toIndex(e.line), toIndex(e.column));
+        if (e.is_range) {
+          ranges.push_back(KTextEditor::Range(start, KTextEditor::Cursor(
+            toIndex(e.end_line), toIndex(e.end_column))));
+        }
+        else {
+          cursors.push_back(start);
+        }
+      }
+    }
+    p = (eol == end) ? end : eol + 1;
+  }
+
+  file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+  return true;
+}
+
+bool MultiCursorPositions::write(
+  const QString & list_file, const QString & document_file
+, std::vector<KTextEditor::Cursor> const & cursors
+, std::vector<KTextEditor::Range> const & ranges)
+{
+  MULTICURSOR_TRACE_FUNCTION("positions");
+  QFile file(list_file);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+
+  const QByteArray path = document_file.toUtf8();
+  // filled then written as one block, the capacity is kept between the
+  // blocks
+  char buffer[1 << 16];
+  int size = 0;
+  char position[64];
+  auto flush = [&]() {
+    const bool ok = file.write(buffer, size) == size;
+    size = 0;
+    return ok;
+  };
+  auto append = [&](const char * data, int n) {
+    if (size + n > int(sizeof(buffer)) && !flush()) {
+      return false;
+    }
+    if (n > int(sizeof(buffer))) {
+      return file.write(data, n) == n;
+    }
+    std::memcpy(buffer + size, data, n);
+    size += n;
+    return true;
+  };
+
+  for (KTextEditor::Cursor const & c : cursors) {
+    const int n = qsnprintf(position, sizeof(position), ":%d:%d\n"
+    , c.line() + 1, c.column() + 1);
+    if (!append(path.constData(), path.size()) || !append(position, n)) {
+      return false;
+    }
+  }
+  for (KTextEditor::Range const & r : ranges) {
+    const int n = qsnprintf(position, sizeof(position), ":%d:%d-%d:%d\n"
+    , r.start().line() + 1, r.start().column() + 1
+    , r.end().line() + 1, r.end().column() + 1);
+    if (!append(path.constData(), path.size()) || !append(position, n)) {
+      return false;
+    }
+  }
+  return flush();
+}
@@ -0,0 +1,51 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_POSITIONS_H
+#define MULTICURSOR_POSITIONS_H
+
+#include <vector>
+
+#include <QString>
+
+#include <KTextEditor/Range>
+
+/**
+ * Lists of positions as written by the compilers and grep:
+ * "file:line:column" for a cursor, "file:line:column-line:column" for a
+ * selection, lines and columns start at 1. Anything after the position
+ * (a message) is ignored, "line:column" without file is accepted.
+ */
+class MultiCursorPositions
+{
+public:
+  /// Entries of an other file than \a document_file are skipped, relative
+  /// paths are relative to the directory of \a list_file.
+  /// The file is mapped in memory.
+  static bool read(
+    const QString & list_file, const QString & document_file
+  , std::vector<KTextEditor::Cursor> & cursors
+  , std::vector<KTextEditor::Range> & ranges);
+
+  static bool write(
+    const QString & list_file, const QString & document_file
+  , std::vector<KTextEditor::Cursor> const & cursors
+  , std::vector<KTextEditor::Range> const & ranges);
+};
+
+#endif
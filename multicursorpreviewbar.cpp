@@ -0,0 +1,103 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursorpreviewbar.h"
+
+#include <KLineEdit>
+#include <KLocale>
+
+#include <QLabel>
+#include <QHBoxLayout>
+#include <QKeyEvent>
+
+MultiCursorPreviewBar::MultiCursorPreviewBar(QWidget * parent)
+: QFrame(parent)
+, m_pattern(new KLineEdit(this))
+, m_status(new QLabel(this))
+{
+  setFrameShape(QFrame::StyledPanel);
+  setAutoFillBackground(true);
+
+  QHBoxLayout * layout = new QHBoxLayout(this);
+  layout->setContentsMargins(2, 2, 2, 2);
+  layout->addWidget(new QLabel(i18n("Regular expression:"), this));
+  layout->addWidget(m_pattern, 1);
+  layout->addWidget(m_status);
+
+  m_pattern->setClearButtonShown(true);
+  m_pattern->installEventFilter(this);
+
+  connect(m_pattern, SIGNAL(textChanged(QString)),
+          this, SIGNAL(patternChanged(QString)));
+  connect(m_pattern, SIGNAL(returnPressed()), this, SIGNAL(accepted()));
+}
+
+QString MultiCursorPreviewBar::pattern() const
+{
+  return m_pattern->text();
+}
+
+void MultiCursorPreviewBar::popup(const QString & pattern)
+{
+  QWidget * view = parentWidget();
+  const int h = sizeHint().height();
+  setGeometry(0, view->height() - h, view->width(), h);
+  m_status->clear();
+  show();
+  raise();
+  // the owner searches the initial pattern itself
+  m_pattern->blockSignals(true);
+  m_pattern->setText(pattern);
+  m_pattern->blockSignals(false);
+  m_pattern->selectAll();
+  m_pattern->setFocus();
+}
+
+void MultiCursorPreviewBar::setMatchCount(int visible, int count)
+{
+  if (count < 0) {
+    m_status->setText(i18np("1 visible match", "%1 visible matches", visible));
+  }
+  else {
+    m_status->setText(i18np("1 match", "%1 matches", count));
+  }
+}
+
+void MultiCursorPreviewBar::setError(const QString & error)
+{
+  m_status->setText(error);
+}
+
+bool MultiCursorPreviewBar::eventFilter(QObject * obj, QEvent * event)
+{
+  if (event->type() == QEvent::ShortcutOverride
+   || event->type() == QEvent::KeyPress) {
+    QKeyEvent * key_event = static_cast<QKeyEvent*>(event);
+    if (key_event->key() == Qt::Key_Escape) {
+      // takes the key from the shortcuts of the view
+      event->accept();
+      if (event->type() == QEvent::KeyPress) {
+        emit rejected();
+      }
+      return true;
+    }
+  }
+  return QFrame::eventFilter(obj, event);
+}
+
+#include "multicursorpreviewbar.moc"
@@ -0,0 +1,61 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_PREVIEW_BAR_H
+#define MULTICURSOR_PREVIEW_BAR_H
+
+#include <QFrame>
+
+class KLineEdit;
+class QLabel;
+
+/**
+ * Pattern line at the bottom of a view. The owner searches the matches,
+ * the bar only reports the typing.
+ */
+class MultiCursorPreviewBar
+: public QFrame
+{
+  Q_OBJECT
+
+public:
+  explicit MultiCursorPreviewBar(QWidget * parent);
+
+  QString pattern() const;
+
+  /// shows the bar at the bottom of its parent and selects the pattern
+  void popup(const QString & pattern);
+
+  /// count < 0 while the whole document is not searched
+  void setMatchCount(int visible, int count);
+  void setError(const QString & error);
+
+signals:
+  void patternChanged(const QString & pattern);
+  void accepted();
+  void rejected();
+
+protected:
+  bool eventFilter(QObject * obj, QEvent * event);
+
+private:
+  KLineEdit * m_pattern;
+  QLabel * m_status;
+};
+
+#endif
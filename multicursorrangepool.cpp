@@ -0,0 +1,75 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursorrangepool.h"
+
+#include <KTextEditor/MovingInterface>
+#include <KTextEditor/MovingRange>
+
+void MultiCursorRangePool::Deleter::operator()(
+  KTextEditor::MovingRange * range) const
+{
+  if (m_pool) {
+    m_pool->give(range);
+  }
+  else {
+    delete range;
+  }
+}
+
+MultiCursorRangePool::~MultiCursorRangePool()
+{
+  clear();
+}
+
+KTextEditor::MovingRange * MultiCursorRangePool::take(
+  KTextEditor::MovingInterface * smart, const KTextEditor::Range & range)
+{
+  if (m_spares.empty()) {
+    ++m_counters.created;
+    return smart->newMovingRange(range);
+  }
+  ++m_counters.reused;
+  KTextEditor::MovingRange * moving_range = m_spares.back();
+  m_spares.pop_back();
+  moving_range->setRange(range);
+  return moving_range;
+}
+
+void MultiCursorRangePool::give(KTextEditor::MovingRange * range)
+{
+  if (m_suspended || m_spares.size() >= max_spares) {
+    ++m_counters.deleted;
+    delete range;
+    return ;
+  }
+  ++m_counters.recycled;
+  range->setFeedback(nullptr);
+  range->setAttribute(KTextEditor::Attribute::Ptr());
+  range->setRange(KTextEditor::Range::invalid());
+  m_spares.push_back(range);
+}
+
+void MultiCursorRangePool::clear()
+{
+  m_counters.deleted += m_spares.size();
+  for (KTextEditor::MovingRange * range : m_spares) {
+    delete range;
+  }
+  std::vector<KTextEditor::MovingRange*>().swap(m_spares);
+}
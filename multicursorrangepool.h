@@ -0,0 +1,114 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_RANGEPOOL_H
+#define MULTICURSOR_RANGEPOOL_H
+
+#include <vector>
+
+#include <QtGlobal>
+
+namespace KTextEditor
+{
+  class MovingInterface;
+  class MovingRange;
+  class Range;
+}
+
+/**
+ * MovingRanges of the virtual cursors and selections given back to be
+ * reused by the next additions instead of being deleted and created again.
+ * A spare range is invalid (out of the text blocks of KatePart, not updated
+ * by the edits), without attribute nor feedback.
+ */
+class MultiCursorRangePool
+{
+public:
+  /// spare ranges kept, the others are deleted
+  static const std::size_t max_spares = 16384;
+
+  struct Counters
+  {
+    /// newMovingRange() calls
+    qint64 created = 0;
+    qint64 reused = 0;
+    qint64 recycled = 0;
+    /// delete calls
+    qint64 deleted = 0;
+  };
+
+  /// gives the range back to its pool, or deletes it without pool
+  class Deleter
+  {
+  public:
+    Deleter(MultiCursorRangePool * pool = nullptr) noexcept
+    : m_pool(pool)
+    {}
+
+    void operator()(KTextEditor::MovingRange * range) const;
+
+  private:
+    MultiCursorRangePool * m_pool;
+  };
+
+  /// The ranges given during its lifetime are deleted, a range cannot be
+  /// changed in the callbacks of MovingRangeFeedback.
+  class Suspend
+  {
+  public:
+    Suspend(MultiCursorRangePool & pool)
+    : m_pool(pool)
+    { ++m_pool.m_suspended; }
+
+    ~Suspend()
+    { --m_pool.m_suspended; }
+
+  private:
+    Suspend(Suspend const &);
+    Suspend& operator=(Suspend const &);
+
+    MultiCursorRangePool & m_pool;
+  };
+
+  MultiCursorRangePool() = default;
+  ~MultiCursorRangePool();
+
+  /// a spare range moved to \a range or a new one
+  KTextEditor::MovingRange * take(
+    KTextEditor::MovingInterface * smart, const KTextEditor::Range & range);
+  void give(KTextEditor::MovingRange * range);
+
+  /// deletes the spare ranges
+  void clear();
+
+  std::size_t spares() const
+  { return m_spares.size(); }
+
+  Counters const & counters() const
+  { return m_counters; }
+
+private:
+  MultiCursorRangePool(MultiCursorRangePool const &);
+  MultiCursorRangePool& operator=(MultiCursorRangePool const &);
+
+  std::vector<KTextEditor::MovingRange*> m_spares;
+  Counters m_counters;
+  int m_suspended = 0;
+};
+
+#endif
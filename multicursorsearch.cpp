@@ -0,0 +1,162 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "multicursorsearch.h"
+#include "multicursortracer.h"
+
+#include <KTextEditor/Document>
+
+#include <QtConcurrentMap>
+
+namespace {
+struct Chunk
+{
+  int first;
+  int last;
+  std::vector<KTextEditor::Range> matches;
+};
+}
+
+MultiCursorSearch::Snapshot MultiCursorSearch::snapshot(
+  KTextEditor::Document * doc, const KTextEditor::Range & range)
+{
+  MULTICURSOR_TRACE("snapshot", "search");
+  Snapshot snapshot;
+  snapshot.first_line = range.start().line();
+  snapshot.first_column = range.start().column();
+  snapshot.last_column = range.end().column();
+  const int last_line = qMin(range.end().line(), doc->lines() - 1);
+  snapshot.lines.reserve(last_line - snapshot.first_line + 1);
+  for (int line = snapshot.first_line; line <= last_line; ++line) {
+    snapshot.lines.push_back(doc->line(line));
+  }
+  return snapshot;
+}
+
+std::vector<KTextEditor::Range> MultiCursorSearch::findAll(
+  const Snapshot & snapshot, const QRegExp & regex, bool allow_empty
+, const Cancel & cancel)
+{
+  MULTICURSOR_TRACE("findAll", "search");
+
+  const int nlines = int(snapshot.lines.size());
+  std::vector<Chunk> chunks;
+  chunks.reserve(nlines / lines_by_chunk + 1);
+  for (int first = 0; first < nlines; first += lines_by_chunk) {
+    chunks.push_back(Chunk{first, qMin(first + lines_by_chunk, nlines), {}});
+  }
+
+  QtConcurrent::blockingMap(chunks, [&snapshot, &regex, &cancel, allow_empty, nlines](
+    Chunk & chunk
+  ) {
+    MULTICURSOR_TRACE("chunk", "search");
+    if (cancel.isCanceled()) {
+      return ;
+    }
+    // QRegExp keeps the captures, a copy by thread
+    const QRegExp re(regex);
+    for (int i = chunk.first; i < chunk.last; ++i) {
+      const QString & text = snapshot.lines[i];
+      const int line = snapshot.first_line + i;
+      const int last_column = (i + 1 == nlines)
+        ? qMin(snapshot.last_column, text.size())
+        : text.size();
+      int column = (i == 0) ? snapshot.first_column : 0;
+      while (column <= last_column) {
+        const int pos = re.indexIn(text, column);
+        if (pos == -1) {
+          break;
+        }
+        const int len = re.matchedLength();
+        if (pos + len > last_column) {
+          break;
+        }
+        if (len || allow_empty) {
+          chunk.matches.push_back(KTextEditor::Range(line, pos, line, pos + len));
+        }
+        column = pos + (len ? len : 1);
+      }
+    }
+  });
+
+  std::vector<KTextEditor::Range> matches;
+  if (cancel.isCanceled()) {
+    return matches;
+  }
+  std::size_t total = 0;
+  for (Chunk const & chunk : chunks) {
+    total += chunk.matches.size();
+  }
+  matches.reserve(total);
+  for (Chunk const & chunk : chunks) {
+    matches.insert(matches.end(), chunk.matches.begin(), chunk.matches.end());
+  }
+  return matches;
+}
+
+std::vector<KTextEditor::Range> MultiCursorSearch::refine(
+  const Snapshot & snapshot
+, const std::vector<KTextEditor::Range> & prefix_matches
+, const QString & needle
+, const Cancel & cancel)
+{
+  MULTICURSOR_TRACE("refine", "search");
+
+  std::vector<KTextEditor::Range> matches;
+  const int len = needle.size();
+  const int nlines = int(snapshot.lines.size());
+  int checked = 0;
+  for (KTextEditor::Range const & r : prefix_matches) {
+    if (!(++checked & 0xffff) && cancel.isCanceled()) {
+      return std::vector<KTextEditor::Range>();
+    }
+    const int i = r.start().line() - snapshot.first_line;
+    const QString & text = snapshot.lines[i];
+    const int end = r.start().column() + len;
+    const int last_column = (i + 1 == nlines)
+      ? qMin(snapshot.last_column, text.size())
+      : text.size();
+    if (end > last_column
+     || text.midRef(r.start().column(), len) != needle) {
+      continue;
+    }
+    // the search does not return overlapping matches
+    if (!matches.empty()
+     && matches.back().end().line() == r.start().line()
+     && matches.back().end().column() > r.start().column()) {
+      continue;
+    }
+    matches.push_back(KTextEditor::Range(r.start(), len));
+  }
+  return matches;
+}
+
+bool MultiCursorSearch::isRefinable(const QString & needle)
+{
+  // prefix function of Knuth-Morris-Pratt, the last value is the longest
+  // border
+  const int n = needle.size();
+  std::vector<int> border(n, 0);
+  for (int i = 1; i < n; ++i) {
+    int k = border[i-1];
+    while (k && needle[i] != needle[k]) {
+      k = border[k-1];
+    }
+    border[i] = (needle[i] == needle[k]) ? k + 1 : 0;
+  }
+  return n && !border[n-1];
+}
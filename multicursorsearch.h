@@ -0,0 +1,115 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MULTICURSOR_SEARCH_H
+#define MULTICURSOR_SEARCH_H
+
+#include <vector>
+#include <memory>
+
+#include <QString>
+#include <QRegExp>
+#include <QAtomicInt>
+
+#include <KTextEditor/Range>
+
+namespace KTextEditor
+{
+  class Document;
+}
+
+
+class MultiCursorSearch
+{
+public:
+  /// Read-only copy of the lines of a range, QString is implicitly shared
+  /// so this does not copy the text and can be read by other threads.
+  struct Snapshot
+  {
+    int first_line;
+    int first_column;
+    int last_column;
+    std::vector<QString> lines;
+  };
+
+  static Snapshot snapshot(
+    KTextEditor::Document * doc, const KTextEditor::Range & range);
+
+  /// shared with the running searches
+  typedef std::shared_ptr<const Snapshot> SharedSnapshot;
+
+  /// A search stops (and returns nothing) as soon as the counter no longer
+  /// has the value, the owner increments it to drop a stale search.
+  struct Cancel
+  {
+    std::shared_ptr<QAtomicInt> counter;
+    int value;
+
+    bool isCanceled() const
+    { return counter && int(*counter) != value; }
+  };
+
+  /// Splits the snapshot in chunks of lines searched on the thread pool.
+  /// Matches are sorted and never span several lines.
+  static std::vector<KTextEditor::Range> findAll(
+    const Snapshot & snapshot, const QRegExp & regex, bool allow_empty
+  , const Cancel & cancel = Cancel());
+
+  /// Matches of \a needle from the matches of one of its prefixes, without
+  /// searching the text again. Exact when the prefix is refinable().
+  static std::vector<KTextEditor::Range> refine(
+    const Snapshot & snapshot
+  , const std::vector<KTextEditor::Range> & prefix_matches
+  , const QString & needle
+  , const Cancel & cancel = Cancel());
+
+  /// true when two occurrences of \a needle cannot overlap (no border),
+  /// then a search finds all of them
+  static bool isRefinable(const QString & needle);
+
+  static const int lines_by_chunk = 4096;
+
+  /// for QtConcurrent::run
+  struct FindAll
+  {
+    typedef std::vector<KTextEditor::Range> result_type;
+
+    SharedSnapshot snapshot;
+    QRegExp regex;
+    bool allow_empty;
+    Cancel cancel;
+
+    result_type operator()() const
+    { return findAll(*snapshot, regex, allow_empty, cancel); }
+  };
+
+  /// for QtConcurrent::run
+  struct Refine
+  {
+    typedef std::vector<KTextEditor::Range> result_type;
+
+    SharedSnapshot snapshot;
+    std::vector<KTextEditor::Range> prefix_matches;
+    QString needle;
+    Cancel cancel;
+
+    result_type operator()() const
+    { return refine(*snapshot, prefix_matches, needle, cancel); }
+  };
+};
+
+#endif
@@ -0,0 +1,181 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursorsequence.h"
+#include "multicursortracer.h"
+
+#include <QStringList>
+#include <QDate>
+
+namespace {
+/// digits of \a value from the end of \a end, returns the first digit
+char * writeDigits(char * end, quint64 value, int base, bool is_upper)
+{
+  const char * digits = is_upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  do {
+    *--end = digits[value % base];
+    value /= base;
+  } while (value);
+  return end;
+}
+
+void append(QString & buffer, const char * first, const char * last)
+{
+  for (; first != last; ++first) {
+    buffer += QChar(*first);
+  }
+}
+
+void appendNumber(
+  QString & buffer, qint64 value, int base, int width, bool is_upper)
+{
+  char tmp[72];
+  char * const end = tmp + sizeof(tmp);
+  const bool is_negative = value < 0;
+  char * first = writeDigits(
+    end, is_negative ? quint64(-(value + 1)) + 1 : quint64(value), base, is_upper);
+  while (end - first < width && first != tmp + 1) {
+    *--first = '0';
+  }
+  if (is_negative) {
+    *--first = '-';
+  }
+  append(buffer, first, end);
+}
+
+/// a, b, ..., z, aa, ab, ...
+void appendLetters(QString & buffer, qint64 value, bool is_upper)
+{
+  char tmp[16];
+  char * const end = tmp + sizeof(tmp);
+  char * first = end;
+  quint64 n = quint64(qMax<qint64>(0, value)) + 1;
+  do {
+    --n;
+    *--first = char((is_upper ? 'A' : 'a') + n % 26);
+    n /= 26;
+  } while (n);
+  append(buffer, first, end);
+}
+
+qint64 parseLetters(const QString & s, bool & is_upper, bool & ok)
+{
+  ok = !s.isEmpty() && s.size() <= 12;
+  is_upper = ok && s[0].isUpper();
+  qint64 n = 0;
+  for (int i = 0; ok && i < s.size(); ++i) {
+    const int c = s[i].unicode() - (is_upper ? 'A' : 'a');
+    ok = 0 <= c && c < 26;
+    n = n * 26 + c + 1;
+  }
+  return n - 1;
+}
+}
+
+bool MultiCursorSequence::parse(const QString & spec)
+{
+  const QStringList parts = spec.trimmed().split(':');
+  if (parts.size() > 3 || parts.first().isEmpty()) {
+    return false;
+  }
+  QString const & start = parts.first();
+  bool ok = true;
+
+  m_step = 1;
+  if (parts.size() > 1) {
+    m_step = parts[1].toLongLong(&ok);
+    if (!ok) {
+      return false;
+    }
+  }
+  m_width = 0;
+  if (parts.size() > 2) {
+    m_width = parts[2].toInt(&ok);
+    if (!ok || m_width < 0 || m_width > 64) {
+      return false;
+    }
+  }
+
+  m_is_upper = false;
+  if (start.size() > 2 && start[0] == '0' && (start[1] == 'x' || start[1] == 'X')) {
+    m_kind = Hexadecimal;
+    m_start = start.mid(2).toLongLong(&ok, 16);
+    m_is_upper = start[1] == 'X';
+    if (!m_width) {
+      m_width = start.size() - 2;
+    }
+  }
+  else if (start.size() == 10 && start[4] == '-' && start[7] == '-') {
+    m_kind = Date;
+    const QDate date = QDate::fromString(start, "yyyy-MM-dd");
+    ok = date.isValid();
+    m_start = date.toJulianDay();
+  }
+  else if (start[0].isLetter()) {
+    m_kind = Letters;
+    m_start = parseLetters(start, m_is_upper, ok);
+  }
+  else {
+    m_kind = Decimal;
+    m_start = start.toLongLong(&ok);
+    const int digits = start.size() - (start[0] == '-' ? 1 : 0);
+    if (!m_width && digits > 1 && start[start.size() - digits] == '0') {
+      m_width = digits;
+    }
+  }
+  return ok;
+}
+
+void MultiCursorSequence::format(
+  std::size_t n, QString & buffer, std::vector<int> & offsets) const
+{
+  MULTICURSOR_TRACE_FUNCTION("sequence");
+  buffer.clear();
+  buffer.reserve(int(n * std::size_t(qMax(m_width, m_kind == Date ? 10 : 4))));
+  offsets.clear();
+  offsets.reserve(n + 1);
+
+  qint64 value = m_start;
+  for (std::size_t i = 0; i < n; ++i, value += m_step) {
+    offsets.push_back(buffer.size());
+    switch (m_kind) {
+      case Decimal:
+        appendNumber(buffer, value, 10, m_width, false);
+        break;
+      case Hexadecimal:
+        appendNumber(buffer, value, 16, m_width, m_is_upper);
+        break;
+      case Letters:
+        appendLetters(buffer, value, m_is_upper);
+        break;
+      case Date: {
+        int year;
+        int month;
+        int day;
+        QDate::fromJulianDay(value).getDate(&year, &month, &day);
+        appendNumber(buffer, year, 10, 4, false);
+        buffer += QChar('-');
+        appendNumber(buffer, month, 10, 2, false);
+        buffer += QChar('-');
+        appendNumber(buffer, day, 10, 2, false);
+        break;
+      }
+    }
+  }
+  offsets.push_back(buffer.size());
+}
@@ -0,0 +1,53 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_SEQUENCE_H
+#define MULTICURSOR_SEQUENCE_H
+
+#include <vector>
+
+#include <QString>
+
+/**
+ * Sequence written as "start[:step[:width]]":
+ * - decimal: "1", "-10:5", "007" (the zeros give the width), "1:1:4"
+ * - hexadecimal: "0x0f" or "0X0F" for the uppercase
+ * - letters: "a", "aa", "A" (a..z, aa..az, ...)
+ * - dates: "2024-01-31" (yyyy-MM-dd), the step is in days
+ */
+class MultiCursorSequence
+{
+public:
+  enum Kind { Decimal, Hexadecimal, Letters, Date };
+
+  /// false when \a spec is invalid
+  bool parse(const QString & spec);
+
+  /// The \a n first values are written one after the other in \a buffer,
+  /// the value i is at [offsets[i], offsets[i+1]).
+  void format(std::size_t n, QString & buffer, std::vector<int> & offsets) const;
+
+private:
+  Kind m_kind = Decimal;
+  qint64 m_start = 1;
+  qint64 m_step = 1;
+  int m_width = 0;
+  bool m_is_upper = false;
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursorsession.h"
+#include "multicursortracer.h"
+
+#include <KTextEditor/Document>
+
+#include <KStandardDirs>
+#include <KSaveFile>
+#include <KUrl>
+
+#include <QFile>
+#include <QHash>
+#include <QtEndian>
+#include <QCryptographicHash>
+
+#include <cstring>
+
+namespace {
+const char magic[4] = {'M', 'C', 'S', '1'};
+
+struct Header
+{
+  char magic[4];
+  quint32 checksum;
+  quint32 cursors_size;
+  quint32 ranges_size;
+};
+}
+
+QString MultiCursorSession::fileName(const KUrl & url)
+{
+  if (url.isEmpty()) {
+    return QString();
+  }
+  const QByteArray hash = QCryptographicHash::hash(
+    url.url().toUtf8(), QCryptographicHash::Md5).toHex();
+  return KStandardDirs::locateLocal("data", "ktexteditor_multicursor/sessions/"
+    + QString::fromLatin1(hash.constData(), hash.size()) + ".bin");
+}
+
+quint32 MultiCursorSession::checksum(KTextEditor::Document * doc)
+{
+  MULTICURSOR_TRACE_FUNCTION("session");
+  // FNV-1a on the hash of the lines
+  quint32 h = 2166136261u;
+  const int lines = doc->lines();
+  for (int line = 0; line < lines; ++line) {
+    h = (h ^ qHash(doc->line(line))) * 16777619u;
+  }
+  return (h ^ quint32(lines)) * 16777619u;
+}
+
+bool MultiCursorSession::save(
+  const QString & filename, quint32 checksum
+, const MultiCursorCodec::PackedSet & set)
+{
+  MULTICURSOR_TRACE_FUNCTION("session");
+  KSaveFile file(filename);
+  if (!file.open()) {
+    return false;
+  }
+
+  Header header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.checksum = qToLittleEndian(checksum);
+  header.cursors_size = qToLittleEndian(quint32(set.cursors.size()));
+  header.ranges_size = qToLittleEndian(quint32(set.ranges.size()));
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(set.cursors);
+  file.write(set.ranges);
+  return file.finalize();
+}
+
+bool MultiCursorSession::load(
+  const QString & filename, quint32 checksum
+, std::vector<KTextEditor::Cursor> & cursors
+, std::vector<KTextEditor::Range> & ranges)
+{
+  MULTICURSOR_TRACE_FUNCTION("session");
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(Header))) {
+    return false;
+  }
+  const uchar * data = file.map(0, file.size());
+  if (!data) {
+    return false;
+  }
+
+  Header header;
+  std::memcpy(&header, data, sizeof(header));
+  const quint32 cursors_size = qFromLittleEndian(header.cursors_size);
+  const quint32 ranges_size = qFromLittleEndian(header.ranges_size);
+  const bool is_valid
+    = !std::memcmp(header.magic, magic, sizeof(magic))
+    && qFromLittleEndian(header.checksum) == checksum
+    && qint64(sizeof(header)) + cursors_size + ranges_size == file.size();
+  if (is_valid) {
+    const char * p = reinterpret_cast<const char*>(data) + sizeof(header);
+    MultiCursorCodec::decode(p, cursors_size, cursors);
+    MultiCursorCodec::decode(p + cursors_size, ranges_size, ranges);
+  }
+  file.unmap(const_cast<uchar*>(data));
+  return is_valid;
+}
@@ -0,0 +1,58 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_SESSION_H
+#define MULTICURSOR_SESSION_H
+
+#include "multicursorcodec.h"
+
+#include <QString>
+
+namespace KTextEditor
+{
+  class Document;
+}
+
+class KUrl;
+
+/**
+ * Sidecar file of the virtual cursors and selections of a document:
+ * a header (magic, checksum of the content, sizes) then the positions
+ * packed by MultiCursorCodec.
+ */
+class MultiCursorSession
+{
+public:
+  /// file in the user data dir, empty when the document has no url
+  static QString fileName(const KUrl & url);
+
+  static quint32 checksum(KTextEditor::Document * doc);
+
+  static bool save(
+    const QString & filename, quint32 checksum
+  , const MultiCursorCodec::PackedSet & set);
+
+  /// The file is mapped in memory. Returns false when it is missing,
+  /// corrupted or made for another content.
+  static bool load(
+    const QString & filename, quint32 checksum
+  , std::vector<KTextEditor::Cursor> & cursors
+  , std::vector<KTextEditor::Range> & ranges);
+};
+
+#endif
@@ -0,0 +1,177 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "multicursortracer.h"
+
+#include <vector>
+#include <memory>
+
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QThread>
+#include <QtCore/QCoreApplication>
+
+QAtomicInt MultiCursorTracer::enabled(0);
+
+namespace {
+struct Event
+{
+  const char * name;
+  const char * category;
+  char phase;
+  qint64 ts;
+  qint64 value;
+  quint64 tid;
+};
+
+struct TraceState
+{
+  QMutex mutex;
+  std::unique_ptr<QFile> file;
+  QElapsedTimer timer;
+  std::vector<Event> events;
+  bool has_event = false;
+};
+
+TraceState & state()
+{
+  static TraceState s;
+  return s;
+}
+
+// flushed when full, a slow session keeps a bounded memory
+const std::size_t max_events = 1 << 16;
+
+void flush(TraceState & s)
+{
+  char buf[512];
+  const qint64 pid = QCoreApplication::applicationPid();
+  for (Event const & e : s.events) {
+    // a truncated event would break the JSON, it is dropped
+    auto fits = [&buf](int n) { return 0 <= n && n < int(sizeof(buf)); };
+    int n = qsnprintf(buf, sizeof(buf)
+    , "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%lld.%03lld"
+      ",\"pid\":%lld,\"tid\":%llu"
+    , s.has_event ? ",\n" : ""
+    , e.name, e.category, e.phase
+    , e.ts / 1000, e.ts % 1000
+    , pid, e.tid);
+    if (!fits(n)) {
+      continue;
+    }
+    int tail;
+    if (e.phase == 'X') {
+      tail = qsnprintf(buf + n, sizeof(buf) - n
+      , ",\"dur\":%lld.%03lld}", e.value / 1000, e.value % 1000);
+    }
+    else if (e.phase == 'C') {
+      tail = qsnprintf(buf + n, sizeof(buf) - n
+      , ",\"args\":{\"value\":%lld}}", e.value);
+    }
+    else {
+      tail = qsnprintf(buf + n, sizeof(buf) - n, "}");
+    }
+    if (tail < 0 || !fits(n + tail)) {
+      continue;
+    }
+    n += tail;
+    s.file->write(buf, n);
+    s.has_event = true;
+  }
+  s.events.clear();
+  s.file->flush();
+}
+
+void push(const char * name, const char * category, char phase
+, qint64 ts, qint64 value)
+{
+  TraceState & s = state();
+  QMutexLocker lock(&s.mutex);
+  if (!s.file) {
+    return ;
+  }
+  const Event e = {
+    name, category, phase, ts, value
+  , quint64(reinterpret_cast<quintptr>(QThread::currentThreadId()))
+  };
+  s.events.push_back(e);
+  if (s.events.size() == max_events) {
+    flush(s);
+  }
+}
+}
+
+bool MultiCursorTracer::start(const QString & filename)
+{
+  stop();
+
+  TraceState & s = state();
+  QMutexLocker lock(&s.mutex);
+  std::unique_ptr<QFile> file(new QFile(filename));
+  if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+  file->write("{\"traceEvents\":[\n");
+  s.file = std::move(file);
+  s.has_event = false;
+  s.events.reserve(max_events);
+  s.timer.start();
+  enabled.fetchAndStoreOrdered(1);
+  return true;
+}
+
+void MultiCursorTracer::stop()
+{
+  TraceState & s = state();
+  QMutexLocker lock(&s.mutex);
+  enabled.fetchAndStoreOrdered(0);
+  if (s.file) {
+    flush(s);
+    s.file->write("\n]}\n");
+    s.file->close();
+    s.file.reset();
+    std::vector<Event>().swap(s.events);
+  }
+}
+
+qint64 MultiCursorTracer::now()
+{
+  return state().timer.nsecsElapsed();
+}
+
+void MultiCursorTracer::begin(const char * name, const char * category)
+{
+  push(name, category, 'B', now(), 0);
+}
+
+void MultiCursorTracer::end(const char * name, const char * category)
+{
+  push(name, category, 'E', now(), 0);
+}
+
+void MultiCursorTracer::complete(
+  const char * name, const char * category, qint64 start, qint64 duration)
+{
+  push(name, category, 'X', start, duration);
+}
+
+void MultiCursorTracer::counter(
+  const char * name, const char * category, qint64 value)
+{
+  push(name, category, 'C', now(), value);
+}
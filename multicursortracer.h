@@ -0,0 +1,85 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MULTICURSOR_TRACER_H
+#define MULTICURSOR_TRACER_H
+
+#include <QString>
+#include <QAtomicInt>
+
+/**
+ * Opt-in tracer writing the Chrome trace-event format (JSON), readable by
+ * chrome://tracing and ui.perfetto.dev.
+ * Names and categories must be string literals (only pointers are kept).
+ */
+class MultiCursorTracer
+{
+public:
+  /// read from the QtConcurrent workers too
+  static bool isEnabled()
+  { return enabled != 0; }
+
+  static bool start(const QString & filename);
+  static void stop();
+
+  static qint64 now();
+
+  static void begin(const char * name, const char * category);
+  static void end(const char * name, const char * category);
+  static void complete(
+    const char * name, const char * category, qint64 start, qint64 duration);
+  static void counter(const char * name, const char * category, qint64 value);
+
+  class Span
+  {
+  public:
+    Span(const char * name, const char * category)
+    : m_name(name)
+    , m_category(category)
+    , m_start(isEnabled() ? now() : -1)
+    {}
+
+    ~Span()
+    {
+      if (m_start != -1 && isEnabled()) {
+        complete(m_name, m_category, m_start, now() - m_start);
+      }
+    }
+
+  private:
+    Span(Span const &);
+    Span& operator=(Span const &);
+
+    const char * m_name;
+    const char * m_category;
+    qint64 m_start;
+  };
+
+private:
+  static QAtomicInt enabled;
+};
+
+#define MULTICURSOR_TRACE_CAT_(Line) multicursor_trace_span_##Line
+#define MULTICURSOR_TRACE_NAME_(Line) MULTICURSOR_TRACE_CAT_(Line)
+
+#define MULTICURSOR_TRACE(Name, Category) \
+  MultiCursorTracer::Span MULTICURSOR_TRACE_NAME_(__LINE__)(Name, Category)
+
+#define MULTICURSOR_TRACE_FUNCTION(Category) \
+  MULTICURSOR_TRACE(__func__, Category)
+
+#endif
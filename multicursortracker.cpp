@@ -0,0 +1,153 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursortracker.h"
+#include "multicursortracer.h"
+
+#include <algorithm>
+
+void MultiCursorTracker::reset(std::vector<KTextEditor::Cursor> const & cursors)
+{
+  MULTICURSOR_TRACE_FUNCTION("tracker");
+  m_lines.resize(cursors.size());
+  m_columns.resize(cursors.size());
+  for (std::size_t i = 0; i < cursors.size(); ++i) {
+    m_lines[i] = cursors[i].line();
+    m_columns[i] = cursors[i].column();
+  }
+  m_tree.assign(cursors.size() + 1, 0);
+}
+
+void MultiCursorTracker::clear()
+{
+  std::vector<int>().swap(m_lines);
+  std::vector<int>().swap(m_columns);
+  std::vector<int>().swap(m_tree);
+}
+
+std::size_t MultiCursorTracker::bytes() const
+{
+  return (m_lines.capacity() + m_columns.capacity() + m_tree.capacity())
+    * sizeof(int);
+}
+
+int MultiCursorTracker::line(std::size_t i) const
+{
+  int delta = 0;
+  for (std::size_t n = i + 1; n; n &= n - 1) {
+    delta += m_tree[n];
+  }
+  return m_lines[i] + delta;
+}
+
+void MultiCursorTracker::addLines(std::size_t i, int delta)
+{
+  for (std::size_t n = i + 1; n < m_tree.size(); n += n & (~n + 1)) {
+    m_tree[n] += delta;
+  }
+}
+
+std::size_t MultiCursorTracker::lowerBound(KTextEditor::Cursor const & c) const
+{
+  std::size_t first = 0;
+  std::size_t count = m_lines.size();
+  while (count) {
+    const std::size_t step = count / 2;
+    const std::size_t i = first + step;
+    const int l = line(i);
+    if (l < c.line() || (l == c.line() && m_columns[i] < c.column())) {
+      first = i + 1;
+      count -= step + 1;
+    }
+    else {
+      count = step;
+    }
+  }
+  return first;
+}
+
+void MultiCursorTracker::textInserted(KTextEditor::Range const & range)
+{
+  const KTextEditor::Cursor & start = range.start();
+  const KTextEditor::Cursor & end = range.end();
+  const std::size_t first = lowerBound(start);
+  if (first == m_lines.size()) {
+    return ;
+  }
+  const std::size_t last = lowerBound(KTextEditor::Cursor(start.line() + 1, 0));
+  // the cursors at the position move with the text
+  const int columns = end.column() - start.column();
+  for (std::size_t i = first; i < last; ++i) {
+    m_columns[i] += columns;
+  }
+  if (const int lines = end.line() - start.line()) {
+    addLines(first, lines);
+  }
+}
+
+void MultiCursorTracker::textRemoved(KTextEditor::Range const & range)
+{
+  const KTextEditor::Cursor & start = range.start();
+  const KTextEditor::Cursor & end = range.end();
+  const std::size_t first = lowerBound(start);
+  if (first == m_lines.size()) {
+    return ;
+  }
+  const std::size_t middle = lowerBound(end);
+  const std::size_t last = lowerBound(KTextEditor::Cursor(end.line() + 1, 0));
+  for (std::size_t i = first; i < middle; ++i) {
+    if (const int delta = start.line() - line(i)) {
+      addLines(i, delta);
+      addLines(i + 1, -delta);
+    }
+    m_columns[i] = start.column();
+  }
+  const int columns = start.column() - end.column();
+  for (std::size_t i = middle; i < last; ++i) {
+    m_columns[i] += columns;
+  }
+  if (const int lines = end.line() - start.line()) {
+    addLines(middle, -lines);
+  }
+}
+
+std::vector<KTextEditor::Cursor> MultiCursorTracker::positions() const
+{
+  MULTICURSOR_TRACE_FUNCTION("tracker");
+  if (m_lines.empty()) {
+    return {};
+  }
+  // the Fenwick tree back to the deltas of each cursor in linear time
+  std::vector<int> deltas(m_tree);
+  for (std::size_t n = deltas.size() - 1; n > 0; --n) {
+    const std::size_t parent = n + (n & (~n + 1));
+    if (parent < deltas.size()) {
+      deltas[parent] -= deltas[n];
+    }
+  }
+
+  std::vector<KTextEditor::Cursor> cursors;
+  cursors.reserve(m_lines.size());
+  int delta = 0;
+  for (std::size_t i = 0; i < m_lines.size(); ++i) {
+    delta += deltas[i + 1];
+    cursors.push_back(KTextEditor::Cursor(m_lines[i] + delta, m_columns[i]));
+  }
+  cursors.erase(std::unique(cursors.begin(), cursors.end()), cursors.end());
+  return cursors;
+}
@@ -0,0 +1,73 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_TRACKER_H
+#define MULTICURSOR_TRACKER_H
+
+#include <vector>
+
+#include <KTextEditor/Range>
+
+/**
+ * Cursors kept as plain positions, without MovingRange, while they are idle.
+ * An edit only finds the cursors at the edited position (binary search) and
+ * adds its line delta to a Fenwick tree indexed by the rank of the cursors,
+ * the edits never reorder them. The columns are only changed for the
+ * cursors on the edited line.
+ * The positions are computed by positions().
+ */
+class MultiCursorTracker
+{
+public:
+  /// \a cursors must be sorted
+  void reset(std::vector<KTextEditor::Cursor> const & cursors);
+  void clear();
+
+  bool isEmpty() const
+  { return m_lines.empty(); }
+
+  std::size_t size() const
+  { return m_lines.size(); }
+
+  std::size_t bytes() const;
+
+  /// \a range is the inserted text
+  void textInserted(KTextEditor::Range const & range);
+  /// \a range is the removed text, the cursors inside go to its start
+  void textRemoved(KTextEditor::Range const & range);
+
+  /// sorted and unique
+  std::vector<KTextEditor::Cursor> positions() const;
+
+private:
+  /// current line of the cursor \a i
+  int line(std::size_t i) const;
+  /// adds \a delta to the line of the cursors from \a i to the end
+  void addLines(std::size_t i, int delta);
+  /// first cursor not before \a c
+  std::size_t lowerBound(KTextEditor::Cursor const & c) const;
+
+  /// lines at reset()
+  std::vector<int> m_lines;
+  std::vector<int> m_columns;
+  /// Fenwick tree (1-based) of the line deltas, the prefix sum up to a
+  /// cursor is the delta of its line
+  std::vector<int> m_tree;
+};
+
+#endif
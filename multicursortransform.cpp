@@ -0,0 +1,157 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "multicursortransform.h"
+#include "multicursortracer.h"
+
+#include <QStringList>
+#include <QSet>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+
+namespace {
+struct Chunk
+{
+  std::size_t first;
+  std::size_t last;
+  std::vector<std::size_t> changed;
+};
+
+QString titleCase(const QString & text)
+{
+  QString result = text;
+  bool is_word_start = true;
+  for (int i = 0; i < result.size(); ++i) {
+    const QChar c = result[i];
+    if (c.isLetterOrNumber()) {
+      result[i] = is_word_start ? c.toUpper() : c.toLower();
+      is_word_start = false;
+    }
+    else {
+      is_word_start = true;
+    }
+  }
+  return result;
+}
+
+QString uniqueLines(const QString & text)
+{
+  QStringList lines = text.split('\n');
+  QSet<QString> seen;
+  QStringList result;
+  for (QString const & line : lines) {
+    if (!seen.contains(line)) {
+      seen.insert(line);
+      result.append(line);
+    }
+  }
+  return result.join("\n");
+}
+}
+
+QString MultiCursorTransform::transform(const QString & text, QRegExp & regex) const
+{
+  switch (m_kind) {
+    case Upper:
+      return text.toUpper();
+    case Lower:
+      return text.toLower();
+    case Title:
+      return titleCase(text);
+    case Trim:
+      return text.trimmed();
+    case SortLines: {
+      QStringList lines = text.split('\n');
+      lines.sort();
+      return lines.join("\n");
+    }
+    case UniqueLines:
+      return uniqueLines(text);
+    case Replace: {
+      QString result = text;
+      return result.replace(regex, m_replacement);
+    }
+  }
+  return text;
+}
+
+std::vector<std::size_t> MultiCursorTransform::run(
+  std::vector<QString> & texts) const
+{
+  MULTICURSOR_TRACE_FUNCTION("transform");
+
+  std::vector<Chunk> chunks;
+  chunks.reserve(texts.size() / texts_by_chunk + 1);
+  for (std::size_t first = 0; first < texts.size(); first += texts_by_chunk) {
+    chunks.push_back(Chunk{
+      first, std::min(first + texts_by_chunk, texts.size()), {}});
+  }
+
+  QtConcurrent::blockingMap(chunks, [this, &texts](Chunk & chunk) {
+    MULTICURSOR_TRACE("chunk", "transform");
+    // QRegExp keeps the captures, a copy by thread
+    QRegExp regex(m_regex);
+    for (std::size_t i = chunk.first; i < chunk.last; ++i) {
+      QString text = transform(texts[i], regex);
+      if (text != texts[i]) {
+        texts[i] = text;
+        chunk.changed.push_back(i);
+      }
+    }
+  });
+
+  std::vector<std::size_t> changed;
+  for (Chunk const & chunk : chunks) {
+    changed.insert(changed.end(), chunk.changed.begin(), chunk.changed.end());
+  }
+  return changed;
+}
+
+std::vector<KTextEditor::Range> MultiCursorTransform::replacedRanges(
+  std::vector<KTextEditor::Range> const & ranges
+, std::vector<QString> const & texts)
+{
+  std::vector<KTextEditor::Range> result;
+  result.reserve(ranges.size());
+  // shift of the lines after the previous range and of the columns of its
+  // last line
+  int line_shift = 0;
+  int previous_end_line = -1;
+  int column_shift = 0;
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    KTextEditor::Range const & r = ranges[i];
+    QString const & text = texts[i];
+    const KTextEditor::Cursor start(
+      r.start().line() + line_shift
+    , r.start().column()
+      + (r.start().line() == previous_end_line ? column_shift : 0));
+
+    const int newlines = text.count('\n');
+    const KTextEditor::Cursor end = newlines
+      ? KTextEditor::Cursor(
+          start.line() + newlines, text.size() - text.lastIndexOf('\n') - 1)
+      : KTextEditor::Cursor(start.line(), start.column() + text.size());
+    result.push_back(KTextEditor::Range(start, end));
+
+    line_shift += newlines - (r.end().line() - r.start().line());
+    column_shift = end.column() - r.end().column();
+    previous_end_line = r.end().line();
+  }
+  return result;
+}
@@ -0,0 +1,78 @@
+/*
+* This file is part of Katepart
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MULTICURSOR_TRANSFORM_H
+#define MULTICURSOR_TRANSFORM_H
+
+#include <vector>
+
+#include <QString>
+#include <QRegExp>
+
+#include <KTextEditor/Range>
+
+/**
+ * Text transforms of the virtual selections. The texts are transformed in
+ * place on the thread pool, the caller copies them from the document and
+ * writes back those that changed.
+ */
+class MultiCursorTransform
+{
+public:
+  enum Kind
+  {
+    Upper,
+    Lower,
+    Title,
+    Trim,
+    SortLines,
+    UniqueLines,
+    Replace
+  };
+
+  explicit MultiCursorTransform(Kind kind)
+  : m_kind(kind)
+  {}
+
+  /// Replace: \\1 to \\9 are the captures
+  MultiCursorTransform(const QRegExp & regex, const QString & replacement)
+  : m_kind(Replace)
+  , m_regex(regex)
+  , m_replacement(replacement)
+  {}
+
+  /// returns the indexes of the texts that changed
+  std::vector<std::size_t> run(std::vector<QString> & texts) const;
+
+  QString transform(const QString & text, QRegExp & regex) const;
+
+  /// Positions of the ranges after their replacement by \a texts, the edits
+  /// being applied in one batch
+  static std::vector<KTextEditor::Range> replacedRanges(
+    std::vector<KTextEditor::Range> const & ranges
+  , std::vector<QString> const & texts);
+
+  static const int texts_by_chunk = 1024;
+
+private:
+  Kind m_kind;
+  QRegExp m_regex;
+  QString m_replacement;
+};
+
+#endif
@@ -17,21 +17,41 @@
 
 #include "multicursorview.h"
 #include "multicursorplugin.h"
+#include "multicursortracer.h"
+#include "multicursorsearch.h"
+#include "multicursorpreviewbar.h"
+#include "multicursorsession.h"
+#include "multicursorpositions.h"
+#include "multicursortransform.h"
+#include "multicursorpipe.h"
+#include "multicursorsequence.h"
 
 #include <functional>
 #include <algorithm>
+#include <iterator>
 
 #include <KTextEditor/View>
 #include <KTextEditor/Document>
 #include <KTextEditor/MovingInterface>
 #include <KTextEditor/HighlightInterface>
+#include <KTextEditor/CoordinatesToCursorInterface>
+#include <KTextEditor/ConfigInterface>
 
 #include <KAction>
 #include <KActionCollection>
-
+#include <KXMLGUIFactory>
+#include <KMessageBox>
+#include <KInputDialog>
+#include <KFileDialog>
+#include <KGlobal>
+#include <KLocale>
+
+#include <QtConcurrentRun>
 #include <QtGui/QApplication>
 #include <QClipboard>
+#include <QFile>
 #include <QKeyEvent>
+#include <QSignalMapper>
 
 namespace {
 template<class Cont, class T>
@@ -53,12 +73,14 @@ struct MultiCursorView::CursorListDetail
 {
   template<class Cont, class Checker>
   static void eraseInvalided(
-    MultiCursorView & cursorview
+    SharedState & state
   , Cont & cont
   , KTextEditor::MovingRange* range
   , Checker checker)
   {
-    if (!cursorview.m_is_moved && !cursorview.m_has_exclusive_edit) {
+    if (!state.is_moved && !state.has_exclusive_edit) {
+      // KatePart still uses the range, it cannot be recycled
+      MultiCursorRangePool::Suspend suspend(state.pool);
       auto pos = std::find_if(
         cont.begin()
       , cont.end()
@@ -72,6 +94,38 @@ struct MultiCursorView::CursorListDetail
     }
   }
 
+  /// Turns on the line length cache of the view for one action, the
+  /// length is dropped when the outer scope ends.
+  class LineLengthScope
+  {
+  public:
+    LineLengthScope(MultiCursorView const & view)
+    : m_cache(view.m_line_lengths)
+    {
+      ++m_cache.depth;
+    }
+
+    ~LineLengthScope()
+    {
+      if (--m_cache.depth) {
+        return;
+      }
+      if (MultiCursorTracer::isEnabled()) {
+        MultiCursorTracer::counter("lineLengthHits", "cache", m_cache.hits);
+        MultiCursorTracer::counter("lineLengthMisses", "cache", m_cache.misses);
+      }
+      m_cache.line = -1;
+      m_cache.hits = 0;
+      m_cache.misses = 0;
+    }
+
+  private:
+    LineLengthScope(LineLengthScope const &);
+    LineLengthScope& operator=(LineLengthScope const &);
+
+    LineLengthCache & m_cache;
+  };
+
   template<class GetCursor1, class GetCursor2, class F>
   static void selectAlgo(
     bool b, MultiCursorView & mview, GetCursor1 get1, GetCursor2 get2, F f)
@@ -79,11 +133,14 @@ struct MultiCursorView::CursorListDetail
     mview.m_ranges_temp.swap(mview.m_ranges);
     mview.m_ranges.clear();
     mview.m_ranges.reserve(mview.m_ranges_temp.size());
+    mview.updateSizePeak();
 
+    // each MovingRange is recycled by the range that replaces it
     if (b) {
       for (Range & r : mview.m_ranges_temp) {
         auto const & c = get1(r);
         KTextEditor::Range range(f(c.line(), c.column()), get2(r));
+        r.recycle();
         mview.setRange(range, false);
       }
     }
@@ -91,6 +148,7 @@ struct MultiCursorView::CursorListDetail
       for (Range & r : mview.m_ranges_temp) {
         auto const & c = get2(r);
         KTextEditor::Range range(f(c.line(), c.column()), get1(r));
+        r.recycle();
         mview.setRange(range, false);
       }
     }
@@ -396,6 +454,316 @@ public:
       it != cont.begin() ? cur(*--it) : cur(cont.back()));
   }
 
+  /// Repeats an edition on the other documents of the synchronized group,
+  /// one transaction per document.
+  template<class F>
+  static void broadcast(MultiCursorView & from, F f)
+  {
+    MultiCursorPlugin * plugin = MultiCursorPlugin::self();
+    if (!from.m_is_synchronized_document || from.m_is_remote_edit || !plugin) {
+      return ;
+    }
+
+    std::vector<KTextEditor::Document*> docs(1, from.m_document);
+    for (MultiCursorView * v : plugin->synchronizedDocuments()) {
+      // closed views are null, only the views that opted in are edited
+      if (!v || !v->m_is_synchronized_document || v->m_cursors.empty()
+       || std::find(docs.begin(), docs.end(), v->m_document) != docs.end()) {
+        continue;
+      }
+      docs.push_back(v->m_document);
+      MULTICURSOR_TRACE("broadcast", "edit");
+      v->m_is_remote_edit = true;
+      v->m_document->startEditing();
+      f(*v);
+      v->m_document->endEditing();
+      v->m_is_remote_edit = false;
+    }
+  }
+
+  static std::vector<KTextEditor::Range>::iterator lowerBoundRange(
+    std::vector<KTextEditor::Range> & ranges, const KTextEditor::Cursor & cursor
+  ) {
+    return lowerBound(ranges, cursor
+    , [](KTextEditor::Range const & r, KTextEditor::Cursor const & c) {
+        return r.start() < c;
+      }
+    );
+  }
+
+  /// Keeps the cursors inside the ranges (bounds included) or those
+  /// outside, both sequences are sorted so it is a single pass.
+  static void filterCursors(
+    CursorList & cursors, RangeList const & ranges, bool inside
+  ) {
+    auto range = ranges.begin();
+    auto out = cursors.begin();
+    for (auto it = cursors.begin(); it != cursors.end(); ++it) {
+      while (range != ranges.end() && range->end() < it->cursor()) {
+        ++range;
+      }
+      const bool is_inside
+        = range != ranges.end() && range->start() <= it->cursor();
+      if (is_inside == inside) {
+        if (out != it) {
+          *out = std::move(*it);
+        }
+        ++out;
+      }
+    }
+    cursors.erase(out, cursors.end());
+  }
+
+  /// records the cursors and the selections changed by an action
+  class HistoryRecord
+  {
+  public:
+    HistoryRecord(MultiCursorView & view)
+    : m_view(view)
+    , m_is_outer(!view.m_shared->history.depth++)
+    , m_revision(-1)
+    {
+      if (m_is_outer) {
+        m_cursors = view.cursorPositions();
+        m_ranges = view.rangePositions();
+        // the action can edit the document
+        m_revision = view.m_smart->revision();
+        view.m_smart->lockRevision(m_revision);
+      }
+    }
+
+    ~HistoryRecord()
+    {
+      --m_view.m_shared->history.depth;
+      if (m_is_outer) {
+        m_view.pushHistory(
+          std::move(m_cursors), std::move(m_ranges), m_revision);
+        m_view.updateMemoryPeak();
+      }
+    }
+
+  private:
+    HistoryRecord(HistoryRecord const &);
+    HistoryRecord& operator=(HistoryRecord const &);
+
+    MultiCursorView & m_view;
+    bool m_is_outer;
+    qint64 m_revision;
+    std::vector<KTextEditor::Cursor> m_cursors;
+    std::vector<KTextEditor::Range> m_ranges;
+  };
+
+  static bool rangeLess(
+    KTextEditor::Range const & a, KTextEditor::Range const & b)
+  {
+    return a.start() < b.start()
+      || (a.start() == b.start() && a.end() < b.end());
+  }
+
+  template<class T, class Less>
+  static std::vector<T> difference(
+    std::vector<T> const & a, std::vector<T> const & b, Less less)
+  {
+    std::vector<T> result;
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end()
+    , std::back_inserter(result), less);
+    return result;
+  }
+
+  static std::vector<KTextEditor::Cursor> unionCursors(
+    std::vector<KTextEditor::Cursor> const & a
+  , std::vector<KTextEditor::Cursor> const & b)
+  {
+    std::vector<KTextEditor::Cursor> result;
+    result.reserve(a.size() + b.size());
+    std::set_union(a.begin(), a.end(), b.begin(), b.end()
+    , std::back_inserter(result));
+    return result;
+  }
+
+  /// overlapping and touching selections are merged, as setRange() does
+  static std::vector<KTextEditor::Range> unionRanges(
+    std::vector<KTextEditor::Range> const & a
+  , std::vector<KTextEditor::Range> const & b)
+  {
+    std::vector<KTextEditor::Range> result;
+    result.reserve(a.size() + b.size());
+    auto push = [&result](KTextEditor::Range const & r) {
+      if (!result.empty() && r.start() <= result.back().end()) {
+        if (result.back().end() < r.end()) {
+          result.back().setRange(result.back().start(), r.end());
+        }
+      }
+      else {
+        result.push_back(r);
+      }
+    };
+    auto it1 = a.begin();
+    auto it2 = b.begin();
+    while (it1 != a.end() && it2 != b.end()) {
+      push(rangeLess(*it2, *it1) ? *it2++ : *it1++);
+    }
+    std::for_each(it1, a.end(), push);
+    std::for_each(it2, b.end(), push);
+    return result;
+  }
+
+  /// Moves all the cursors by \a delta lines in one pass, the column
+  /// follows the rules of moveCursorToUp() (the largest of the column and
+  /// the kept column, bounded by the line). Cursors that meet are merged
+  /// once at the end.
+  static void moveCursorsByLines(MultiCursorView & view, int delta)
+  {
+    MULTICURSOR_TRACE("moveCursorsByLines", "bulk");
+    LineLengthScope line_lengths(view);
+    const int last_line = view.m_document->lines() - 1;
+    for (Cursor & c : view.m_cursors) {
+      const int line = qBound(0, c.line() + delta, last_line);
+      const int column = qMax(c.column(), c.getKeepedColumn());
+      c.setCursorAndKeepColumn(
+        line, qMin(view.lineLength(line), column), column);
+    }
+    // the kept columns and the bounded lines can reorder a few cursors
+    if (!std::is_sorted(view.m_cursors.begin(), view.m_cursors.end())) {
+      std::sort(view.m_cursors.begin(), view.m_cursors.end());
+    }
+    uniqueCont(view.m_cursors);
+    view.checkCursors();
+  }
+
+  /// Moves the start (\a move_start) or the end of all the selections in
+  /// one pass, then merges those that overlap.
+  template<class F>
+  static void selectByLines(MultiCursorView & view, bool move_start, F f)
+  {
+    MULTICURSOR_TRACE("selectByLines", "bulk");
+    std::vector<KTextEditor::Range> ranges = view.rangePositions();
+    auto out = ranges.begin();
+    for (KTextEditor::Range const & r : ranges) {
+      const KTextEditor::Cursor fixed = move_start ? r.end() : r.start();
+      const KTextEditor::Cursor moved = f(move_start ? r.start() : r.end());
+      if (moved != fixed) {
+        *out++ = (moved < fixed)
+          ? KTextEditor::Range(moved, fixed)
+          : KTextEditor::Range(fixed, moved);
+      }
+    }
+    ranges.erase(out, ranges.end());
+    if (!std::is_sorted(ranges.begin(), ranges.end(), rangeLess)) {
+      std::sort(ranges.begin(), ranges.end(), rangeLess);
+    }
+    view.assignRanges(unionRanges(ranges, std::vector<KTextEditor::Range>()));
+  }
+
+  /// Deletion planner of the cursors: the span of each cursor (\a span_of)
+  /// is computed first, overlapping or touching spans are merged and
+  /// removed from the last one in one transaction. A cursor goes to the
+  /// start of its span, the positions are computed and not left to the
+  /// MovingRanges (their feedback is off during the removals).
+  /// Returns false when the view cannot edit, the edit is then not
+  /// broadcasted.
+  template<class SpanOf>
+  static bool deleteSpans(MultiCursorView & view, SpanOf span_of)
+  {
+    MULTICURSOR_TRACE("deleteSpans", "bulk");
+    if (!view.canEdit()) {
+      return false;
+    }
+    // deleted by KatePart
+    const KTextEditor::Cursor real_cursor = view.realCursor();
+    std::vector<KTextEditor::Cursor> targets = view.cursorPositions();
+    std::vector<KTextEditor::Range> spans;
+    spans.reserve(targets.size());
+    for (KTextEditor::Cursor & c : targets) {
+      if (c == real_cursor) {
+        continue;
+      }
+      const KTextEditor::Range span = span_of(c);
+      if (!span.isEmpty()) {
+        spans.push_back(span);
+        c = span.start();
+      }
+    }
+    if (spans.empty()) {
+      return true;
+    }
+
+    if (!std::is_sorted(spans.begin(), spans.end(), rangeLess)) {
+      std::sort(spans.begin(), spans.end(), rangeLess);
+    }
+    auto out = spans.begin();
+    for (auto it = spans.begin() + 1; it != spans.end(); ++it) {
+      if (it->start() <= out->end()) {
+        if (out->end() < it->end()) {
+          out->setRange(out->start(), it->end());
+        }
+      }
+      else {
+        *++out = *it;
+      }
+    }
+    spans.erase(out + 1, spans.end());
+
+    if (!std::is_sorted(targets.begin(), targets.end())) {
+      std::sort(targets.begin(), targets.end());
+    }
+
+    // positions after the removal of the spans before them
+    std::vector<KTextEditor::Cursor> cursors;
+    cursors.reserve(targets.size());
+    auto span = spans.begin();
+    int removed_lines = 0;
+    int last_end_line = -1;
+    int last_end_column = 0;
+    KTextEditor::Cursor last_start;
+    auto map = [&](KTextEditor::Cursor const & c) {
+      return c.line() == last_end_line
+        ? KTextEditor::Cursor(
+            last_start.line(), last_start.column() + c.column() - last_end_column)
+        : KTextEditor::Cursor(c.line() - removed_lines, c.column());
+    };
+    for (KTextEditor::Cursor const & c : targets) {
+      while (span != spans.end() && span->end() <= c) {
+        last_start = map(span->start());
+        removed_lines += span->end().line() - span->start().line();
+        last_end_line = span->end().line();
+        last_end_column = span->end().column();
+        ++span;
+      }
+      cursors.push_back(map(
+        (span != spans.end() && span->start() <= c) ? span->start() : c));
+      if (cursors.size() > 1 && cursors[cursors.size() - 2] == cursors.back()) {
+        cursors.pop_back();
+      }
+    }
+
+    if (!view.startEditing()) {
+      return false;
+    }
+    for (Cursor & c : view.m_cursors) {
+      c.setFeedback(nullptr);
+    }
+    for (auto it = spans.rbegin(); it != spans.rend(); ++it) {
+      view.removeText(*it);
+    }
+    for (Cursor & c : view.m_cursors) {
+      c.setFeedback(&view.m_shared->invalided_cursor);
+    }
+    view.endEditing();
+    view.assignCursors(cursors);
+    return true;
+  }
+
+  /// column on screen, the tabs go to the next multiple of \a tab_width
+  static int visualColumn(const QString & text, int column, int tab_width)
+  {
+    int x = 0;
+    for (int i = 0; i < column; ++i) {
+      x = (text[i] == '\t') ? (x / tab_width + 1) * tab_width : x + 1;
+    }
+    return x;
+  }
+
   static RangeList::iterator lowerBoundEnd(
     RangeList & ranges, const KTextEditor::Cursor & cursor
   ) {
@@ -411,21 +779,23 @@ public:
 void MultiCursorView::InvalidedCursor
 ::rangeEmpty(KTextEditor::MovingRange* range)
 {
+  MULTICURSOR_TRACE("InvalidedCursor::rangeEmpty", "feedback");
   CursorListDetail::eraseInvalided(
-    m_cursorview
-  , m_cursorview.m_cursors
+    m_state
+  , m_state.cursors
   , range
-  , [this]() { m_cursorview.checkCursors(); });
+  , [this]() { m_state.views.front()->checkCursors(); });
 }
 
 void MultiCursorView::InvalidedRange
 ::rangeEmpty(KTextEditor::MovingRange* range)
 {
+  MULTICURSOR_TRACE("InvalidedRange::rangeEmpty", "feedback");
   CursorListDetail::eraseInvalided(
-    m_cursorview
-  , m_cursorview.m_ranges
+    m_state
+  , m_state.ranges
   , range
-  , [this]() { m_cursorview.checkRanges(); });
+  , [this]() { m_state.views.front()->checkRanges(); });
 }
 
 
@@ -433,6 +803,7 @@ MultiCursorView::MultiCursorView(
   KTextEditor::View *view
 , KTextEditor::Attribute::Ptr cursor_attr
 , KTextEditor::Attribute::Ptr selection_attr
+, std::shared_ptr<SharedState> shared
 )
 : QObject(view)
 , KXMLGUIClient(view)
@@ -441,18 +812,32 @@ MultiCursorView::MultiCursorView(
 , m_smart(qobject_cast<KTextEditor::MovingInterface*>(m_document))
 , m_cursor_attr(cursor_attr)
 , m_selection_attr(selection_attr)
-, m_has_exclusive_edit(false)
-, m_is_active(true)
+, m_shared(shared ? shared : std::make_shared<SharedState>())
+, m_cursors(m_shared->cursors)
+, m_ranges(m_shared->ranges)
+, m_ranges_temp(m_shared->ranges_temp)
+, m_has_exclusive_edit(m_shared->has_exclusive_edit)
+, m_is_active(m_shared->is_active)
 , m_is_synchronized_cursor(false)
 , m_is_synchronized_selection(false)
 , m_remove_cursor_if_only_click(false)
 , m_has_cursor_ctrl(false)
 , m_has_selection_ctrl(false)
 , m_remove_all_if_esc(false)
-, m_is_moved(false)
-, m_invalided_cursor(*this)
-, m_invalided_range(*this)
+, m_is_moved(m_shared->is_moved)
+, m_is_synchronized_document(false)
+, m_is_remote_edit(false)
+, m_has_actions(false)
+, m_has_connected_cursors(false)
+, m_is_editing_traced(false)
+, m_occurrences_watcher(nullptr)
+, m_macro_mapper(nullptr)
 {
+  MULTICURSOR_TRACE("MultiCursorView", "init");
+
+  m_shared->views.push_back(this);
+  m_shared->smart = m_smart;
+
 	setComponentData(MultiCursorPluginFactory::componentData());
 
 	KActionCollection* collection = actionCollection();
@@ -469,6 +854,111 @@ MultiCursorView::MultiCursorView(
 	ENTRY("Set Virtual Cursor", "set_multicursor", setCursor());
 	action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_C);
 
+  // the other actions and the menus are created on the first use or the
+  // first focus, the shortcut works without the menus
+  collection->addAssociatedWidget(m_view);
+  connect(m_view, SIGNAL(focusIn(KTextEditor::View*)),
+          this, SLOT(initActions()));
+
+  // joins a document that already has cursors
+  if (!m_cursors.empty()) {
+    initActions();
+    connectCursors();
+    setEnabledCursors(true);
+  }
+  if (!m_ranges.empty()) {
+    initActions();
+    connectRanges();
+    setEnabledRanges(true);
+  }
+  // the cursors of an inactive document stay parked
+  if (m_is_active) {
+    wakeCursors();
+  }
+
+  connect(m_document, SIGNAL(aboutToReload(KTextEditor::Document*)),
+          this, SLOT(documentAboutToReload(KTextEditor::Document*)));
+  connect(m_document, SIGNAL(reloaded(KTextEditor::Document*)),
+          this, SLOT(documentReloaded(KTextEditor::Document*)));
+  connect(m_document, SIGNAL(textChanged(KTextEditor::Document*)),
+          this, SLOT(documentTextChanged(KTextEditor::Document*)));
+
+  MultiCursorPlugin * plugin = MultiCursorPlugin::self();
+  if (plugin && plugin->persistCursors() && m_shared->views.size() == 1) {
+    connect(m_view, SIGNAL(focusIn(KTextEditor::View*)),
+            this, SLOT(restoreSession()));
+  }
+}
+
+/// The actions except "Set Virtual Cursor" and the menus are created on the
+/// first focus or the first use of the plugin in the view: opening a session
+/// with many documents only pays for the shown view.
+void MultiCursorView::initActions()
+{
+  if (m_has_actions) {
+    return ;
+  }
+  m_has_actions = true;
+  disconnect(m_view, SIGNAL(focusIn(KTextEditor::View*)),
+             this, SLOT(initActions()));
+
+  MULTICURSOR_TRACE_FUNCTION("init");
+
+	KActionCollection* collection = actionCollection();
+	KAction *action;
+
+  ENTRY("Set Virtual Selection", "set_multiselection", setRange());
+  action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_R);
+
+  ENTRY("Set Virtual Cursors at All Matches", "from_matches_multicursor", cursorsFromMatches());
+
+  ENTRY("Virtual Selections from Matches", "from_matches_multiselection", rangesFromMatches());
+
+  ENTRY("Virtual Selections from Matches (Live Preview)", "preview_matches_multiselection", previewMatches());
+  action->setShortcut(Qt::CTRL + Qt::ALT + Qt::SHIFT + Qt::Key_F);
+
+  ENTRY("Add Next Occurrence", "add_next_occurrence_multicursor", addNextOccurrence());
+  action->setShortcut(Qt::CTRL + Qt::ALT + Qt::Key_N);
+
+  ENTRY("Skip Occurrence", "skip_occurrence_multicursor", skipOccurrence());
+
+  ENTRY("Undo Last Occurrence", "undo_occurrence_multicursor", undoLastOccurrence());
+
+  action = new KAction(i18n("Record Macro for Virtuals Cursors"), this);
+  collection->addAction("record_macro_multicursor", action);
+  action->setCheckable(true);
+  action->setShortcut(Qt::CTRL + Qt::ALT + Qt::Key_M);
+  connect(action, SIGNAL(toggled(bool)), this, SLOT(recordMacro(bool)));
+
+  ENTRY("Replay Macro on Virtuals Cursors", "replay_macro_multicursor", replayMacro());
+  action->setShortcut(Qt::CTRL + Qt::ALT + Qt::SHIFT + Qt::Key_M);
+
+  ENTRY("Set Virtual Selection From Virtual Cursors", "from_cursor_multiselection", rangesFromCursors());
+  action->setEnabled(false);
+
+  ENTRY("Enable Virtuals Cursors", "active_multicursor", setActiveCursor())
+	action->setCheckable(true);
+	action->setChecked(m_is_active);
+
+  ENTRY("Synchronize With the Other Documents", "synchronise_documents_multicursor", setSynchronizedDocuments());
+  action->setCheckable(true);
+
+  ENTRY("Undo Virtuals Cursors Change", "undo_multicursor", undoCursors());
+  action->setShortcut(Qt::CTRL + Qt::ALT + Qt::Key_Z);
+
+  ENTRY("Redo Virtuals Cursors Change", "redo_multicursor", redoCursors());
+  action->setShortcut(Qt::CTRL + Qt::ALT + Qt::SHIFT + Qt::Key_Z);
+
+  ENTRY("Store Virtuals Cursors in a Register", "store_register_multicursor", storeRegister());
+
+  ENTRY("Switch to a Register", "switch_register_multicursor", switchRegister());
+
+  ENTRY("Remove a Register", "remove_register_multicursor", removeRegister());
+
+  ENTRY("Import Virtuals Cursors Positions...", "import_positions_multicursor", importPositions());
+
+  ENTRY("Memory Usage of Virtuals Cursors", "memory_multicursor", showMemoryUsage());
+
   ENTRY("Backspace Character on Virtuals Cursors", "backspace_multicursor", backspace());
 	action->setShortcut(Qt::ALT + Qt::Key_Backspace);
 
@@ -487,20 +977,16 @@ MultiCursorView::MultiCursorView(
   ENTRY("Move to Previous Virtual Cursor", "previous_multicursor", moveToPreviousCursor());
 	action->setShortcut(Qt::CTRL + Qt::ALT + Qt::SHIFT + Qt::Key_H);
 
-  ENTRY("Enable Virtuals Cursors", "active_multicursor", setActiveCursor())
-	action->setCheckable(true);
-	action->setChecked(true);
-
-  ENTRY("Synchronize With the Blinking Cursor", "synchronise_multicursor", setSynchronizedCursors());
-  action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_P);
-  action->setCheckable(true);
+  ENTRY("Cut the Lines With a Virtual Cursor", "cut_line_with_cursor", cutLinesWithCursor());
 
   ENTRY("Copy the Lines With a Virtual Cursor", "copy_line_with_cursor", copyLinesWithCursor());
 
-  ENTRY("Cut the Lines With a Virtual Cursor", "cut_line_with_cursor", cutLinesWithCursor());
-
   ENTRY("Paste the Lines on a Virtual Cursor", "paste_line_with_cursor", pasteLinesOnCursors());
 
+  ENTRY("Insert a Sequence on Virtuals Cursors...", "insert_sequence_multicursor", insertSequence());
+
+  ENTRY("Align Virtuals Cursors", "align_multicursor", alignCursors());
+
   ENTRY("Extend the Selection to Left", "extend_left_selection", extendLeftSelection());
   action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_ParenLeft);
 
@@ -511,17 +997,32 @@ MultiCursorView::MultiCursorView(
 
   ENTRY("Reduce the Selection of Right", "reduce_right_selection", reduceRightSelection());
 
+  ENTRY("Synchronize With the Blinking Cursor", "synchronise_multicursor", setSynchronizedCursors());
+  action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_P);
+  action->setCheckable(true);
 
-  ENTRY("Set Virtual Selection", "set_multiselection", setRange());
-  action->setShortcut(Qt::CTRL + Qt::SHIFT + Qt::Key_R);
+  ENTRY("Keep Virtuals Cursors in Virtuals Selections", "keep_in_selection_multicursor", keepCursorsInRanges());
+
+  ENTRY("Remove Virtuals Cursors in Virtuals Selections", "remove_in_selection_multicursor", removeCursorsInRanges());
+
+  ENTRY("Export Virtuals Cursors Positions...", "export_positions_multicursor", exportPositions());
+
+
+  ENTRY("Remove Text In a Virtuals Selections", "clear_multiselection", clearRanges());
+  action->setShortcut(Qt::ALT + Qt::Key_Escape);
 
   ENTRY("Deselect All Virtuals Selections", "remove_all_multiselection", removeAllRanges());
   action->setShortcut(Qt::CTRL + Qt::Key_Underscore);
 
   ENTRY("Deselect Virtuals Selections Line", "remove_line_multiselection", removeRangesOnline());
 
-  ENTRY("Remove Text In a Virtuals Selections", "clear_multiselection", clearRanges());
-  action->setShortcut(Qt::ALT + Qt::Key_Escape);
+  ENTRY("Move to Next Virtual Selection Start", "next_start_multiselection", moveToNextStartRange());
+
+  ENTRY("Move to Previous Virtual Selection Start", "previous_start_multiselection", moveToPreviousStartRange());
+
+  ENTRY("Move to Next Virtual Selection End", "next_end_multiselection", moveToNextEndRange());
+
+  ENTRY("Move to Previous Virtual Selection End", "previous_end_multiselection", moveToPreviousEndRange());
 
   ENTRY("Cut Virtuals Selections", "cut_multiselection", cutRanges());
   action->setShortcut(Qt::CTRL + Qt::ALT + Qt::Key_X);
@@ -532,43 +1033,112 @@ MultiCursorView::MultiCursorView(
   ENTRY("Paste Virtuals Selections", "paste_multiselection", pasteRanges());
   action->setShortcut(Qt::CTRL + Qt::ALT + Qt::Key_V);
 
-  ENTRY("Move to Next Virtual Selection Start", "next_start_multiselection", moveToNextStartRange());
+  ENTRY("Set Virtual Cursors at Virtual Selection Starts", "start_to_cursor_multiselection", cursorsFromRangeStarts());
 
-  ENTRY("Move to Previous Virtual Selection Start", "previous_start_multiselection", moveToPreviousStartRange());
+  ENTRY("Set Virtual Cursors at Virtual Selection Ends", "end_to_cursor_multiselection", cursorsFromRangeEnds());
 
-  ENTRY("Move to Next Virtual Selection End", "next_end_multiselection", moveToNextEndRange());
+  ENTRY("Intersect Virtuals Selections With the Selection", "intersect_multiselection", intersectRangesWithSelection());
 
-  ENTRY("Move to Previous Virtual Selection End", "previous_end_multiselection", moveToPreviousEndRange());
+  ENTRY("Uppercase Virtuals Selections", "upper_case_multiselection", upperCaseRanges());
 
-  ENTRY("Set Virtual Selection From Virtual Cursors", "from_cursor_multiselection", rangesFromCursors());
-  action->setEnabled(false);
+  ENTRY("Lowercase Virtuals Selections", "lower_case_multiselection", lowerCaseRanges());
+
+  ENTRY("Capitalize Virtuals Selections", "title_case_multiselection", titleCaseRanges());
+
+  ENTRY("Trim Virtuals Selections", "trim_multiselection", trimRanges());
+
+  ENTRY("Sort Lines of Virtuals Selections", "sort_lines_multiselection", sortLinesInRanges());
+
+  ENTRY("Remove Duplicate Lines of Virtuals Selections", "unique_lines_multiselection", uniqueLinesInRanges());
+
+  ENTRY("Replace in Virtuals Selections...", "replace_multiselection", replaceInRanges());
+
+  ENTRY("Pipe Each Virtual Selection Through a Command...", "pipe_multiselection", pipeRanges());
+
+  ENTRY("Pipe Virtuals Selections Through a Command (NUL Separated)...", "pipe_joined_multiselection", pipeJoinedRanges());
 
   ENTRY("Synchronize With the Selection", "synchronise_multiselection", setSynchronizedRanges());
   action->setCheckable(true);
 
-#undef ENTRY
-
   setEnabledCursors(false);
-	setEnabledRanges(false);
+  setEnabledRanges(false);
+
 	setXMLFile("multicursorui.rc");
+  // only this client is merged, none of its menus exists yet
+  if (KXMLGUIFactory * gui_factory = factory()) {
+    gui_factory->removeClient(this);
+    gui_factory->addClient(this);
+  }
+}
+
+#undef ENTRY
+
+MultiCursorView::SharedState::~SharedState()
+{
+  if (!smart) {
+    return ;
+  }
+  for (auto & reg : registers) {
+    if (reg.second.revision != -1) {
+      smart->unlockRevision(reg.second.revision);
+    }
+  }
+  for (auto & d : history.undo) {
+    smart->unlockRevision(d.revision());
+  }
+  for (auto & d : history.redo) {
+    smart->unlockRevision(d.revision());
+  }
 }
 
 MultiCursorView::~MultiCursorView()
-{}
+{
+  if (m_is_synchronized_document) {
+    if (MultiCursorPlugin * plugin = MultiCursorPlugin::self()) {
+      plugin->setSynchronizedDocument(this, false);
+    }
+  }
+  auto & views = m_shared->views;
+  if (views.size() == 1) {
+    if (MultiCursorPlugin * plugin = MultiCursorPlugin::self()) {
+      if (plugin->persistCursors()) {
+        saveSession();
+      }
+    }
+  }
+  views.erase(std::find(views.begin(), views.end(), this));
+  // the next owner follows the edits
+  if (!views.empty() && !m_shared->idle_cursors.isEmpty()) {
+    views.front()->connectIdleCursors();
+  }
+}
+
+bool MultiCursorView::isSharedStateOwner() const
+{
+  return m_shared->views.front() == this;
+}
+
+bool MultiCursorView::isEditingView() const
+{
+  return m_shared->views.size() == 1 || m_document->activeView() == m_view;
+}
 
 void MultiCursorView::exclusiveEditStart(KTextEditor::Document *)
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
 	m_has_exclusive_edit = true;
 }
 
 void MultiCursorView::exclusiveEditEnd(KTextEditor::Document *)
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
 	m_has_exclusive_edit = false;
 }
 
 
 void MultiCursorView::deleteLinesWithCursor()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   std::vector<int> lines(m_cursors.size());
   auto pos = lines.begin();
   int last_line = -1;
@@ -586,125 +1156,76 @@ void MultiCursorView::deleteLinesWithCursor()
 
   auto e = lines.begin();
   while (pos != e) {
-    m_document->removeLine(*--pos);
+    removeLine(*--pos);
   }
 }
 
 void MultiCursorView::deleteWordLeft()
 {
-  std::size_t i = m_cursors.size();
-  for (; i != 0; --i) {
-    Cursor & c = m_cursors[i-1];
-    if (c == m_view->cursorPosition()) {
-      continue;
-    }
-    const std::size_t sz = m_cursors.size();
-    m_document->removeText(KTextEditor::Range(
-      CursorListDetail::wordPrev(m_document, c.line(), c.column())
-    , c.cursor()
-    ));
-    i -= sz - m_cursors.size();
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  const bool is_edited = CursorListDetail::deleteSpans(*this, [this](KTextEditor::Cursor const & c) {
+    return KTextEditor::Range(
+      CursorListDetail::wordPrev(m_document, c.line(), c.column()), c);
+  });
+  if (is_edited) {
+    CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+      v.deleteWordLeft();
+    });
   }
 }
 
 void MultiCursorView::deleteWordRight()
 {
-  class RevalidCursor : public KTextEditor::MovingRangeFeedback {
-    MultiCursorView & m_cursorview;
-  public:
-    Cursor * m_cursor;
-    bool m_is_same;
-
-    RevalidCursor(MultiCursorView & cursorview)
-    : m_cursorview(cursorview)
-    {}
-
-    virtual void rangeEmpty(KTextEditor::MovingRange* range) {
-      if (m_cursor->isSame(range)) {
-        m_is_same = true;
-      }
-      else {
-        m_cursorview.m_invalided_cursor.rangeEmpty(range);
-      }
-    }
-  };
-
-  RevalidCursor feedback(*this);
-
-  for (Cursor & c : m_cursors) {
-    c.setFeedback(&feedback);
-  }
-  for (std::size_t i = 0; i < m_cursors.size(); ++i) {
-    Cursor & c = m_cursors[i];
-    feedback.m_cursor = &c;
-    feedback.m_is_same = false;
-    const int line = c.line();
-    const int column = c.column();
-    m_document->removeText(KTextEditor::Range(
-      KTextEditor::Cursor(line, column)
-    , CursorListDetail::wordNext(m_document, line, column)
-    ));
-    if (feedback.m_is_same) {
-      c.setCursor(line, column);
-    }
-  }
-  for (Cursor & c : m_cursors) {
-    c.setFeedback(&m_invalided_cursor);
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  const bool is_edited = CursorListDetail::deleteSpans(*this, [this](KTextEditor::Cursor const & c) {
+    return KTextEditor::Range(
+      c, CursorListDetail::wordNext(m_document, c.line(), c.column()));
+  });
+  if (is_edited) {
+    CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+      v.deleteWordRight();
+    });
   }
 }
 
 void MultiCursorView::backspace()
 {
-  for (std::size_t i = m_cursors.front().cursor().atStartOfDocument()
-  ? 1 : 0; i != m_cursors.size(); ++i) {
-    Cursor & c = m_cursors[i];
-    if (c == m_view->cursorPosition()) {
-      continue;
-    }
-    const std::size_t sz = m_cursors.size();
-    const int line = c.line();
-    const int column = c.column();
-    int column2 = column;
-    int line2 = line;
-    if (!column) {
-      column2 = m_document->lineLength(--line2);
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
+  const bool is_edited = CursorListDetail::deleteSpans(*this, [this](KTextEditor::Cursor const & c) {
+    if (c.column()) {
+      return KTextEditor::Range(c.line(), c.column() - 1, c.line(), c.column());
     }
-    else {
-      --column2;
+    if (c.line()) {
+      return KTextEditor::Range(
+        c.line() - 1, lineLength(c.line() - 1), c.line(), 0);
     }
-    m_document->removeText(KTextEditor::Range(line, column, line2, column2));
-    i -= sz - m_cursors.size();
+    return KTextEditor::Range(c, c);
+  });
+  if (is_edited) {
+    CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+      v.backspace();
+    });
   }
 }
 
 void MultiCursorView::deleteNextCharacter()
 {
-  if (startEditing()) {
-    std::size_t i = m_cursors.size()
-      - (m_cursors.front().cursor().atEndOfDocument() ? 1 : 0);
-    while (i) {
-      Cursor & c = m_cursors[--i];
-      if (c == m_view->cursorPosition()) {
-        continue;
-      }
-      const int line = c.line();
-      const int column = c.column();
-      int column2 = column;
-      int line2 = line;
-      if (column == m_document->lineLength(line)) {
-        column2 = 0;
-        ++line2;
-      }
-      else {
-        ++column2;
-      }
-      m_document->removeText(KTextEditor::Range(line, column, line2, column2));
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
+  const bool is_edited = CursorListDetail::deleteSpans(*this, [this](KTextEditor::Cursor const & c) {
+    if (c.column() != lineLength(c.line())) {
+      return KTextEditor::Range(c.line(), c.column(), c.line(), c.column() + 1);
     }
-    uniqueCont(m_cursors);
-    for (Cursor & c : m_cursors) {
-      c.setCursor(c.cursor());
+    if (c.line() + 1 != m_document->lines()) {
+      return KTextEditor::Range(c.line(), c.column(), c.line() + 1, 0);
     }
-    endEditing();
+    return KTextEditor::Range(c, c);
+  });
+  if (is_edited) {
+    CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+      v.deleteNextCharacter();
+    });
   }
 }
 
@@ -747,11 +1268,20 @@ void MultiCursorView::deleteNextCharacter()
 
 void MultiCursorView::connectCursors()
 {
+  // startCursors() can run while the cursors are disabled
+  if (m_has_connected_cursors || !m_has_actions) {
+    return ;
+  }
+  m_has_connected_cursors = true;
   SIGNALMAN_CURSORS(connect);
 }
 
 void MultiCursorView::disconnectCursors()
 {
+  if (!m_has_actions) {
+    return ;
+  }
+  m_has_connected_cursors = false;
   SIGNALMAN_CURSORS(disconnect);
   if (m_is_synchronized_cursor) {
     actionCollection()->action("synchronise_multicursor")->trigger();
@@ -794,6 +1324,12 @@ void MultiCursorView::disconnectCursors()
     F(                                                                  \
       collec->action("word_right"), SIGNAL(triggered(bool)),            \
       this, SLOT(moveCursorToWordRight()));                             \
+    F(                                                                  \
+      collec->action("scroll_page_up"), SIGNAL(triggered(bool)),        \
+      this, SLOT(moveCursorToPageUp()));                                \
+    F(                                                                  \
+      collec->action("scroll_page_down"), SIGNAL(triggered(bool)),      \
+      this, SLOT(moveCursorToPageDown()));                              \
   } while(0)
 
 void MultiCursorView::connectSynchronizedCursors()
@@ -810,6 +1346,7 @@ void MultiCursorView::disconnectSynchronizedCursors()
 
 void MultiCursorView::setSynchronizedCursors()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   if (m_is_synchronized_cursor) {
     m_is_synchronized_cursor = false;
     disconnectSynchronizedCursors();
@@ -886,12 +1423,12 @@ void MultiCursorView::disconnectRanges()
     F(                                                                     \
       collec->action("select_matching_bracket"), SIGNAL(triggered(bool)),  \
       this, SLOT(selectMatchingBracket()));                                \
-    /*F(                                                                   \
+    F(                                                                     \
       collec->action("select_page_up"), SIGNAL(triggered(bool)),           \
       this, SLOT(selectPageUp()));                                         \
     F(                                                                     \
       collec->action("select_page_down"), SIGNAL(triggered(bool)),         \
-      this, SLOT(selectPageDown()));*/                                     \
+      this, SLOT(selectPageDown()));                                       \
   } while(0)
 
 void MultiCursorView::connectSynchronizedRanges()
@@ -906,6 +1443,7 @@ void MultiCursorView::disconnectSynchronizedRanges()
 
 void MultiCursorView::setSynchronizedRanges()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   if (m_is_synchronized_selection) {
     m_is_synchronized_selection = false;
     disconnectSynchronizedRanges();
@@ -917,14 +1455,26 @@ void MultiCursorView::setSynchronizedRanges()
 
 void MultiCursorView::stopCursors()
 {
-  disconnectCursors();
-  setEnabledCursors(false);
+  for (MultiCursorView * view : m_shared->views) {
+    if (!view->m_has_actions) {
+      continue;
+    }
+    view->disconnectCursors();
+    view->setEnabledCursors(false);
+  }
+  // nothing to reuse them
+  if (m_ranges.empty()) {
+    m_shared->pool.clear();
+  }
 }
 
 void MultiCursorView::startCursors()
 {
-  connectCursors();
-  setEnabledCursors(true);
+  for (MultiCursorView * view : m_shared->views) {
+    view->initActions();
+    view->connectCursors();
+    view->setEnabledCursors(true);
+  }
 }
 
 void MultiCursorView::checkCursors()
@@ -934,16 +1484,98 @@ void MultiCursorView::checkCursors()
   }
 }
 
+std::vector<KTextEditor::Cursor> MultiCursorView::allCursorPositions() const
+{
+  std::vector<KTextEditor::Cursor> cursors = cursorPositions();
+  MultiCursorTracker const & idle = m_shared->idle_cursors;
+  if (!idle.isEmpty()) {
+    const std::vector<KTextEditor::Cursor> parked = idle.positions();
+    std::vector<KTextEditor::Cursor> merged;
+    merged.reserve(cursors.size() + parked.size());
+    std::merge(cursors.begin(), cursors.end(), parked.begin(), parked.end()
+    , std::back_inserter(merged));
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+    cursors.swap(merged);
+  }
+  return cursors;
+}
+
+void MultiCursorView::parkCursors()
+{
+  if (m_is_active || m_cursors.empty()) {
+    return ;
+  }
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  m_shared->idle_cursors.reset(allCursorPositions());
+  CursorList().swap(m_cursors);
+  stopCursors();
+  m_shared->views.front()->connectIdleCursors();
+}
+
+void MultiCursorView::connectIdleCursors()
+{
+  // parkCursors() can merge into cursors already tracked
+  connect(m_document,
+          SIGNAL(textInserted(KTextEditor::Document*,KTextEditor::Range)),
+          this,
+          SLOT(trackTextInserted(KTextEditor::Document*,KTextEditor::Range)),
+          Qt::UniqueConnection);
+  connect(m_document,
+          SIGNAL(textRemoved(KTextEditor::Document*,KTextEditor::Range)),
+          this,
+          SLOT(trackTextRemoved(KTextEditor::Document*,KTextEditor::Range)),
+          Qt::UniqueConnection);
+}
+
+void MultiCursorView::disconnectIdleCursors()
+{
+  disconnect(m_document,
+             SIGNAL(textInserted(KTextEditor::Document*,KTextEditor::Range)),
+             this,
+             SLOT(trackTextInserted(KTextEditor::Document*,KTextEditor::Range)));
+  disconnect(m_document,
+             SIGNAL(textRemoved(KTextEditor::Document*,KTextEditor::Range)),
+             this,
+             SLOT(trackTextRemoved(KTextEditor::Document*,KTextEditor::Range)));
+}
+
+void MultiCursorView::wakeCursors()
+{
+  MultiCursorTracker & idle = m_shared->idle_cursors;
+  if (idle.isEmpty()) {
+    return ;
+  }
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  std::vector<KTextEditor::Cursor> cursors = idle.positions();
+  idle.clear();
+  m_shared->views.front()->disconnectIdleCursors();
+  // the document may have been edited out of the tracking (reload)
+  std::vector<KTextEditor::Range> ranges;
+  normalizePositions(cursors, ranges);
+  setCursors(cursors);
+}
+
 void MultiCursorView::stopRanges()
 {
-  disconnectRanges();
-  setEnabledRanges(false);
+  for (MultiCursorView * view : m_shared->views) {
+    if (!view->m_has_actions) {
+      continue;
+    }
+    view->disconnectRanges();
+    view->setEnabledRanges(false);
+  }
+  if (m_cursors.empty()) {
+    m_shared->pool.clear();
+  }
 }
 
 void MultiCursorView::startRanges()
 {
-  connectRanges();
-  setEnabledRanges(true);
+  for (MultiCursorView * view : m_shared->views) {
+    view->initActions();
+    view->connectRanges();
+    view->setEnabledRanges(true);
+  }
 }
 
 void MultiCursorView::checkRanges()
@@ -967,6 +1599,20 @@ void MultiCursorView::setEnabledRanges(bool x)
   collec->action("previous_start_multiselection")->setEnabled(x);
   collec->action("next_end_multiselection")->setEnabled(x);
   collec->action("previous_end_multiselection")->setEnabled(x);
+  collec->action("start_to_cursor_multiselection")->setEnabled(x);
+  collec->action("end_to_cursor_multiselection")->setEnabled(x);
+  collec->action("intersect_multiselection")->setEnabled(x);
+  collec->action("upper_case_multiselection")->setEnabled(x);
+  collec->action("lower_case_multiselection")->setEnabled(x);
+  collec->action("title_case_multiselection")->setEnabled(x);
+  collec->action("trim_multiselection")->setEnabled(x);
+  collec->action("sort_lines_multiselection")->setEnabled(x);
+  collec->action("unique_lines_multiselection")->setEnabled(x);
+  collec->action("replace_multiselection")->setEnabled(x);
+  collec->action("pipe_multiselection")->setEnabled(x);
+  collec->action("pipe_joined_multiselection")->setEnabled(x);
+  collec->action("keep_in_selection_multicursor")->setEnabled(x);
+  collec->action("remove_in_selection_multicursor")->setEnabled(x);
 }
 
 void MultiCursorView::setEnabledCursors(bool x)
@@ -983,183 +1629,1905 @@ void MultiCursorView::setEnabledCursors(bool x)
   collec->action("copy_line_with_cursor")->setEnabled(x);
   collec->action("cut_line_with_cursor")->setEnabled(x);
   collec->action("paste_line_with_cursor")->setEnabled(x);
+  collec->action("insert_sequence_multicursor")->setEnabled(x);
+  collec->action("align_multicursor")->setEnabled(x);
   collec->action("extend_left_selection")->setEnabled(x);
   collec->action("extend_right_selection")->setEnabled(x);
   collec->action("reduce_left_selection")->setEnabled(x);
   collec->action("reduce_right_selection")->setEnabled(x);
 }
 
-void MultiCursorView::moveCursorToUp()
+void MultiCursorView::moveCursorToUp()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
+  auto first = std::find_if(m_cursors.begin(), m_cursors.end()
+  , [](Cursor const & c) { return c.line() > 0; });
+  auto cpfirst = m_cursors.begin();
+  auto end = m_cursors.end();
+  for (; first != end; ++first, ++cpfirst) {
+    const int line = first->line() - 1;
+    const int column = first->column();
+    if (column < first->getKeepedColumn()) {
+      const int line_len = lineLength(line);
+      cpfirst->setCursor(line, qMin(line_len, first->getKeepedColumn()));
+    }
+    else {
+      cpfirst->setCursorAndKeepColumn(line, column);
+    }
+  }
+  m_cursors.erase(std::unique(m_cursors.begin(), cpfirst), end);
+  checkCursors();
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToUp();
+  });
+}
+
+void MultiCursorView::moveCursorToDown()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
+  auto first = m_cursors.begin();
+  auto end = m_cursors.end();
+  const int lmax = m_document->lines() - 1;
+  for (; first != end; ++first) {
+    if (lmax < first->line()) {
+      break;
+    }
+    const int column = first->column();
+    const int line = first->line() + 1;
+    if (column < first->getKeepedColumn()) {
+      const int line_len = lineLength(line);
+      first->setCursor(line, qMin(line_len, first->getKeepedColumn()));
+    }
+    else {
+      first->setCursorAndKeepColumn(line, column);
+    }
+  }
+  m_cursors.erase(std::unique(m_cursors.begin(), first), end);
+  checkCursors();
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToDown();
+  });
+}
+
+void MultiCursorView::moveCursorToLeft()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
+  auto first = m_cursors.begin();
+  if (m_cursors.front().line() == 0 && m_cursors.front().column() == 0) {
+    ++first;
+  }
+  CursorListDetail::moveCursor(*this, first
+  , [this](Cursor const & cur) {
+    const int l = cur.line();
+    const int c = cur.column();
+    if (c == 0) {
+      return KTextEditor::Cursor(l-1, lineLength(l));
+    }
+    return KTextEditor::Cursor(l, c-1);
+  });
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToLeft();
+  });
+}
+
+void MultiCursorView::moveCursorToRight()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
+  auto first = m_cursors.rbegin();
+  if (m_cursors.back() == m_document->documentEnd()) {
+    ++first;
+  }
+  auto end = m_cursors.rend();
+  if (first != end) {
+    m_cursors.erase(
+      m_cursors.begin()
+    , CursorListDetail::moveCursorImpl(
+        first, end
+      , m_cursors.rbegin()
+      , [this](Cursor const & cur) {
+        const int l = cur.line();
+        const int c = cur.column();
+        if (lineLength(l) == c) {
+          return KTextEditor::Cursor(l+1, 0);
+        }
+        return KTextEditor::Cursor(l, c+1);
+    }).base());
+  }
+  else {
+    m_cursors.clear();
+    stopCursors();
+  }
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToRight();
+  });
+}
+
+void MultiCursorView::moveCursorToBeginningOfLine()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  for (Cursor & c : m_cursors) {
+    c.setCursor(KTextEditor::Cursor(c.line(), 0));
+  }
+  uniqueCont(m_cursors);
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToBeginningOfLine();
+  });
+}
+
+void MultiCursorView::moveCursorToEndOfLine()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
+  for (Cursor & c : m_cursors) {
+    const int l = c.line();
+    c.setCursor(KTextEditor::Cursor(l, lineLength(l)));
+  }
+  uniqueCont(m_cursors);
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToEndOfLine();
+  });
+}
+
+void MultiCursorView::moveCursorToWordLeft()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  for (Cursor & c : m_cursors) {
+    c.setCursor(CursorListDetail::wordPrev(m_document, c.line(), c.column()));
+  }
+  uniqueCont(m_cursors);
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToWordLeft();
+  });
+}
+
+void MultiCursorView::moveCursorToWordRight()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  for (Cursor & c : m_cursors) {
+    c.setCursor(CursorListDetail::wordNext(m_document, c.line(), c.column()));
+  }
+  uniqueCont(m_cursors);
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToWordRight();
+  });
+}
+
+void MultiCursorView::moveCursorToPageUp()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::moveCursorsByLines(*this, -pageLines());
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToPageUp();
+  });
+}
+
+void MultiCursorView::moveCursorToPageDown()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::moveCursorsByLines(*this, pageLines());
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToPageDown();
+  });
+}
+
+void MultiCursorView::moveCursorToMatchingBracket()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  KTextEditor::HighlightInterface *iface
+    = qobject_cast<KTextEditor::HighlightInterface*>(m_document);
+  if (!iface) {
+    iface = &CursorListDetail::fake_highlight();
+  }
+  for (Cursor & c : m_cursors) {
+    KTextEditor::Cursor cursor = c.cursor();
+    if (CursorListDetail::matchingBracket(m_document, iface, cursor)) {
+      c.setCursor(cursor);
+    }
+  }
+  uniqueCont(m_cursors);
+  CursorListDetail::broadcast(*this, [](MultiCursorView & v) {
+    v.moveCursorToMatchingBracket();
+  });
+}
+
+void MultiCursorView::setCursor(const KTextEditor::Cursor& cursor)
+{
+  auto it = lowerBound(m_cursors, cursor);
+  if (it != m_cursors.end() && *it == cursor) {
+    m_cursors.erase(it);
+    checkCursors();
+  }
+  else {
+    Cursor moving_cursor = newMovingCursor(cursor);
+    if (m_cursors.empty()) {
+      m_cursors.push_back(std::move(moving_cursor));
+      startCursors();
+    }
+    else {
+      m_cursors.insert(it, std::move(moving_cursor));
+    }
+    updateSizePeak();
+  }
+}
+
+void MultiCursorView::setCursors(
+  std::vector<KTextEditor::Cursor> const & cursors)
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  if (cursors.empty()) {
+    return ;
+  }
+
+  const bool was_empty = m_cursors.empty();
+  CursorList & result = m_shared->cursors_temp;
+  result.clear();
+  result.reserve(m_cursors.size() + cursors.size());
+  auto first = m_cursors.begin();
+  auto last = m_cursors.end();
+  auto it = cursors.begin();
+  auto end = cursors.end();
+  while (first != last && it != end) {
+    if (*first < *it) {
+      result.push_back(std::move(*first));
+      ++first;
+    }
+    else {
+      if (*first == *it) {
+        result.push_back(std::move(*first));
+        ++first;
+      }
+      else if (result.empty() || !(result.back() == *it)) {
+        result.emplace_back(newMovingCursor(*it));
+      }
+      ++it;
+    }
+  }
+  std::move(first, last, std::back_inserter(result));
+  for (; it != end; ++it) {
+    if (result.empty() || !(result.back() == *it)) {
+      result.emplace_back(newMovingCursor(*it));
+    }
+  }
+
+  m_cursors.swap(result);
+  // only the capacity is kept
+  result.clear();
+  updateSizePeak();
+  if (was_empty) {
+    startCursors();
+  }
+}
+
+std::vector<KTextEditor::Cursor> MultiCursorView::cursorPositions() const
+{
+  std::vector<KTextEditor::Cursor> cursors;
+  cursors.reserve(m_cursors.size());
+  for (auto & c : m_cursors) {
+    cursors.push_back(c.cursor());
+  }
+  return cursors;
+}
+
+std::vector<KTextEditor::Range> MultiCursorView::rangePositions() const
+{
+  std::vector<KTextEditor::Range> ranges;
+  ranges.reserve(m_ranges.size());
+  for (auto & r : m_ranges) {
+    ranges.push_back(r.toRange());
+  }
+  return ranges;
+}
+
+void MultiCursorView::normalizePositions(
+  std::vector<KTextEditor::Cursor> & cursors
+, std::vector<KTextEditor::Range> & ranges) const
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  const int lines = m_document->lines();
+  auto clamp = [this, lines](KTextEditor::Cursor & c) {
+    if (c.line() < 0 || c.line() >= lines) {
+      return false;
+    }
+    c.setColumn(qBound(0, c.column(), m_document->lineLength(c.line())));
+    return true;
+  };
+  cursors.erase(std::remove_if(cursors.begin(), cursors.end()
+  , [&clamp](KTextEditor::Cursor & c) { return !clamp(c); }), cursors.end());
+  ranges.erase(std::remove_if(ranges.begin(), ranges.end()
+  , [this, &clamp](KTextEditor::Range & r) {
+    KTextEditor::Cursor start = r.start();
+    KTextEditor::Cursor end = r.end();
+    if (!clamp(start)) {
+      return true;
+    }
+    if (!clamp(end)) {
+      end = m_document->documentEnd();
+    }
+    r = (start <= end)
+      ? KTextEditor::Range(start, end)
+      : KTextEditor::Range(end, start);
+    return r.isEmpty();
+  }), ranges.end());
+
+  // already sorted by the callers that can
+  if (!std::is_sorted(cursors.begin(), cursors.end())) {
+    std::sort(cursors.begin(), cursors.end());
+  }
+  cursors.erase(std::unique(cursors.begin(), cursors.end()), cursors.end());
+  if (!std::is_sorted(ranges.begin(), ranges.end(), CursorListDetail::rangeLess)) {
+    std::sort(ranges.begin(), ranges.end(), CursorListDetail::rangeLess);
+  }
+}
+
+void MultiCursorView::applyCursors(
+  std::vector<KTextEditor::Cursor> cursors, BatchMode mode)
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  std::vector<KTextEditor::Range> ranges;
+  normalizePositions(cursors, ranges);
+
+  CursorListDetail::HistoryRecord record(*this);
+  switch (mode) {
+    case BatchAdd:
+      setCursors(cursors);
+      break;
+    case BatchReplace:
+      assignCursors(cursors);
+      break;
+    case BatchRemove:
+      assignCursors(CursorListDetail::difference(
+        cursorPositions(), cursors, std::less<KTextEditor::Cursor>()));
+      break;
+  }
+}
+
+void MultiCursorView::applyRanges(
+  std::vector<KTextEditor::Range> ranges, BatchMode mode)
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  std::vector<KTextEditor::Cursor> cursors;
+  normalizePositions(cursors, ranges);
+
+  CursorListDetail::HistoryRecord record(*this);
+  switch (mode) {
+    case BatchAdd:
+      setRanges(ranges);
+      break;
+    case BatchReplace:
+      assignRanges(CursorListDetail::unionRanges(
+        ranges, std::vector<KTextEditor::Range>()));
+      break;
+    case BatchRemove:
+      assignRanges(CursorListDetail::difference(
+        rangePositions(), ranges, &CursorListDetail::rangeLess));
+      break;
+  }
+}
+
+void MultiCursorView::assignCursors(
+  std::vector<KTextEditor::Cursor> const & cursors)
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  const bool was_empty = m_cursors.empty();
+  if (m_cursors.size() > cursors.size()) {
+    m_cursors.erase(m_cursors.begin() + cursors.size(), m_cursors.end());
+  }
+  for (std::size_t i = 0; i < m_cursors.size(); ++i) {
+    m_cursors[i].setCursor(cursors[i]);
+  }
+  m_cursors.reserve(cursors.size());
+  for (std::size_t i = m_cursors.size(); i < cursors.size(); ++i) {
+    m_cursors.emplace_back(newMovingCursor(cursors[i]));
+  }
+  updateSizePeak();
+
+  if (m_cursors.empty()) {
+    if (!was_empty) {
+      stopCursors();
+    }
+  }
+  else if (was_empty) {
+    startCursors();
+  }
+}
+
+void MultiCursorView::assignRanges(
+  std::vector<KTextEditor::Range> const & ranges)
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  const bool was_empty = m_ranges.empty();
+  if (m_ranges.size() > ranges.size()) {
+    m_ranges.erase(m_ranges.begin() + ranges.size(), m_ranges.end());
+  }
+  for (std::size_t i = 0; i < m_ranges.size(); ++i) {
+    m_ranges[i].setRange(ranges[i]);
+  }
+  m_ranges.reserve(ranges.size());
+  for (std::size_t i = m_ranges.size(); i < ranges.size(); ++i) {
+    m_ranges.emplace_back(newMovingRange(ranges[i]));
+  }
+  updateSizePeak();
+
+  if (m_ranges.empty()) {
+    if (!was_empty) {
+      stopRanges();
+    }
+  }
+  else if (was_empty) {
+    startRanges();
+  }
+}
+
+MultiCursorCodec::PackedSet MultiCursorView::pack() const
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  MultiCursorCodec::PackedSet set;
+  set.revision = m_smart->revision();
+  set.cursors = MultiCursorCodec::encode(cursorPositions());
+  set.ranges = MultiCursorCodec::encode(rangePositions());
+  return set;
+}
+
+void MultiCursorView::unpack(MultiCursorCodec::PackedSet const & set)
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  std::vector<KTextEditor::Cursor> cursors;
+  std::vector<KTextEditor::Range> ranges;
+  MultiCursorCodec::decode(set.cursors, cursors);
+  MultiCursorCodec::decode(set.ranges, ranges);
+
+  transformPositions(cursors, ranges, set.revision);
+  assignCursors(cursors);
+  assignRanges(ranges);
+}
+
+void MultiCursorView::transformPositions(
+  std::vector<KTextEditor::Cursor> & cursors
+, std::vector<KTextEditor::Range> & ranges
+, qint64 from_revision) const
+{
+  // the history of KatePart moves the positions, as it does for the
+  // MovingRanges, but only when they are used
+  const qint64 revision = m_smart->revision();
+  if (from_revision == revision) {
+    return ;
+  }
+  for (KTextEditor::Cursor & c : cursors) {
+    m_smart->transformCursor(
+      c, KTextEditor::MovingCursor::MoveOnInsert, from_revision, revision);
+  }
+  for (KTextEditor::Range & r : ranges) {
+    m_smart->transformRange(
+      r, KTextEditor::MovingRange::DoNotExpand
+    , KTextEditor::MovingRange::AllowEmpty, from_revision, revision);
+  }
+  // removed texts merge the positions
+  uniqueCont(cursors);
+}
+
+void MultiCursorView::pushHistory(
+  std::vector<KTextEditor::Cursor> cursors
+, std::vector<KTextEditor::Range> ranges
+, qint64 revision)
+{
+  MULTICURSOR_TRACE_FUNCTION("history");
+  // the old positions are compared in the current revision, the added and
+  // removed positions then share it
+  if (revision != m_smart->revision()) {
+    transformPositions(cursors, ranges, revision);
+    if (!std::is_sorted(ranges.begin(), ranges.end()
+      , &CursorListDetail::rangeLess)) {
+      std::sort(ranges.begin(), ranges.end(), &CursorListDetail::rangeLess);
+    }
+    ranges.erase(std::unique(ranges.begin(), ranges.end()), ranges.end());
+  }
+  m_smart->unlockRevision(revision);
+
+  const std::vector<KTextEditor::Cursor> new_cursors = cursorPositions();
+  const std::vector<KTextEditor::Range> new_ranges = rangePositions();
+  const std::less<KTextEditor::Cursor> cursor_less;
+
+  const auto added_cursors
+    = CursorListDetail::difference(new_cursors, cursors, cursor_less);
+  const auto removed_cursors
+    = CursorListDetail::difference(cursors, new_cursors, cursor_less);
+  const auto added_ranges = CursorListDetail::difference(
+    new_ranges, ranges, &CursorListDetail::rangeLess);
+  const auto removed_ranges = CursorListDetail::difference(
+    ranges, new_ranges, &CursorListDetail::rangeLess);
+  if (added_cursors.empty() && removed_cursors.empty()
+   && added_ranges.empty() && removed_ranges.empty()) {
+    return ;
+  }
+
+  MultiCursorCodec::PackedDelta delta;
+  delta.added.revision = delta.removed.revision = m_smart->revision();
+  delta.added.cursors = MultiCursorCodec::encode(added_cursors);
+  delta.added.ranges = MultiCursorCodec::encode(added_ranges);
+  delta.removed.cursors = MultiCursorCodec::encode(removed_cursors);
+  delta.removed.ranges = MultiCursorCodec::encode(removed_ranges);
+  m_smart->lockRevision(delta.revision());
+
+  SharedState::History & history = m_shared->history;
+  history.undo.push_back(std::move(delta));
+  if (history.undo.size() > SharedState::History::max_size) {
+    m_smart->unlockRevision(history.undo.front().revision());
+    history.undo.pop_front();
+  }
+  for (auto & d : history.redo) {
+    m_smart->unlockRevision(d.revision());
+  }
+  history.redo.clear();
+}
+
+void MultiCursorView::restoreHistory(
+  std::deque<MultiCursorCodec::PackedDelta> & from
+, std::deque<MultiCursorCodec::PackedDelta> & to)
+{
+  MULTICURSOR_TRACE_FUNCTION("history");
+  if (from.empty()) {
+    return ;
+  }
+
+  const MultiCursorCodec::PackedDelta delta = std::move(from.back());
+  from.pop_back();
+
+  std::vector<KTextEditor::Cursor> added_cursors;
+  std::vector<KTextEditor::Cursor> removed_cursors;
+  std::vector<KTextEditor::Range> added_ranges;
+  std::vector<KTextEditor::Range> removed_ranges;
+  MultiCursorCodec::decode(delta.added.cursors, added_cursors);
+  MultiCursorCodec::decode(delta.added.ranges, added_ranges);
+  MultiCursorCodec::decode(delta.removed.cursors, removed_cursors);
+  MultiCursorCodec::decode(delta.removed.ranges, removed_ranges);
+  transformPositions(added_cursors, added_ranges, delta.revision());
+  transformPositions(removed_cursors, removed_ranges, delta.revision());
+  m_smart->unlockRevision(delta.revision());
+
+  assignCursors(CursorListDetail::unionCursors(
+    CursorListDetail::difference(
+      cursorPositions(), added_cursors, std::less<KTextEditor::Cursor>())
+  , removed_cursors));
+  assignRanges(CursorListDetail::unionRanges(
+    CursorListDetail::difference(
+      rangePositions(), added_ranges, &CursorListDetail::rangeLess)
+  , removed_ranges));
+
+  // the reverse change
+  MultiCursorCodec::PackedDelta reverse;
+  reverse.added.revision = reverse.removed.revision = m_smart->revision();
+  reverse.added.cursors = MultiCursorCodec::encode(removed_cursors);
+  reverse.added.ranges = MultiCursorCodec::encode(removed_ranges);
+  reverse.removed.cursors = MultiCursorCodec::encode(added_cursors);
+  reverse.removed.ranges = MultiCursorCodec::encode(added_ranges);
+  m_smart->lockRevision(reverse.revision());
+  to.push_back(std::move(reverse));
+  updateMemoryPeak();
+}
+
+void MultiCursorView::undoCursors()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  restoreHistory(m_shared->history.undo, m_shared->history.redo);
+}
+
+void MultiCursorView::redoCursors()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  restoreHistory(m_shared->history.redo, m_shared->history.undo);
+}
+
+void MultiCursorView::storeInRegister(const QString & name)
+{
+  MultiCursorCodec::PackedSet & reg = m_shared->registers[name];
+  if (reg.revision != -1) {
+    m_smart->unlockRevision(reg.revision);
+  }
+  reg = pack();
+  m_smart->lockRevision(reg.revision);
+  updateMemoryPeak();
+}
+
+void MultiCursorView::saveSession()
+{
+  MULTICURSOR_TRACE_FUNCTION("session");
+  const KUrl url = m_document->url();
+  if (!url.isLocalFile()) {
+    return ;
+  }
+  MultiCursorPlugin * plugin = MultiCursorPlugin::self();
+  if (!plugin) {
+    return ;
+  }
+
+  // the parked cursors are saved without creating their MovingRanges
+  std::vector<KTextEditor::Cursor> cursors = allCursorPositions();
+  std::vector<KTextEditor::Range> ranges = rangePositions();
+  normalizePositions(cursors, ranges);
+
+  // views of the document closed before this one, with another shared state
+  MultiCursorCodec::PackedSet closed;
+  if (plugin->takeClosedSession(m_document, closed)) {
+    std::vector<KTextEditor::Cursor> closed_cursors;
+    std::vector<KTextEditor::Range> closed_ranges;
+    MultiCursorCodec::decode(closed.cursors, closed_cursors);
+    MultiCursorCodec::decode(closed.ranges, closed_ranges);
+    transformPositions(closed_cursors, closed_ranges, closed.revision);
+    m_smart->unlockRevision(closed.revision);
+    normalizePositions(closed_cursors, closed_ranges);
+    cursors = CursorListDetail::unionCursors(cursors, closed_cursors);
+    ranges = CursorListDetail::unionRanges(ranges, closed_ranges);
+  }
+
+  MultiCursorCodec::PackedSet set;
+  set.revision = m_smart->revision();
+  set.cursors = MultiCursorCodec::encode(cursors);
+  set.ranges = MultiCursorCodec::encode(ranges);
+
+  // only the last view of the document writes the file
+  if (plugin->hasView(m_document)) {
+    m_smart->lockRevision(set.revision);
+    plugin->storeClosedSession(m_document, set);
+    return ;
+  }
+
+  const QString filename = MultiCursorSession::fileName(url);
+  if (cursors.empty() && ranges.empty()) {
+    QFile::remove(filename);
+  }
+  else {
+    MultiCursorSession::save(
+      filename, MultiCursorSession::checksum(m_document), set);
+  }
+}
+
+/// Connected to focusIn() of the first view of a document, the sidecar is
+/// read only for the documents really shown.
+void MultiCursorView::restoreSession()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  disconnect(m_view, SIGNAL(focusIn(KTextEditor::View*)),
+             this, SLOT(restoreSession()));
+
+  const KUrl url = m_document->url();
+  if (!url.isLocalFile() || !m_cursors.empty() || !m_ranges.empty()) {
+    return ;
+  }
+
+  std::vector<KTextEditor::Cursor> cursors;
+  std::vector<KTextEditor::Range> ranges;
+  if (MultiCursorSession::load(
+    MultiCursorSession::fileName(url)
+  , MultiCursorSession::checksum(m_document), cursors, ranges)) {
+    // the checksum covers the text, not the positions
+    normalizePositions(cursors, ranges);
+    assignCursors(cursors);
+    assignRanges(CursorListDetail::unionRanges(
+      ranges, std::vector<KTextEditor::Range>()));
+  }
+}
+
+void MultiCursorView::documentAboutToReload(KTextEditor::Document*)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  if (!isSharedStateOwner()) {
+    return ;
+  }
+
+  // KatePart forgets its revisions with the reload: the history is dropped
+  // and the registers are anchored to the text
+  SharedState::History & history = m_shared->history;
+  for (auto & d : history.undo) {
+    m_smart->unlockRevision(d.revision());
+  }
+  for (auto & d : history.redo) {
+    m_smart->unlockRevision(d.revision());
+  }
+  history.undo.clear();
+  history.redo.clear();
+  for (auto & reg : m_shared->registers) {
+    std::vector<KTextEditor::Cursor> cursors;
+    std::vector<KTextEditor::Range> ranges;
+    MultiCursorCodec::decode(reg.second.cursors, cursors);
+    MultiCursorCodec::decode(reg.second.ranges, ranges);
+    transformPositions(cursors, ranges, reg.second.revision);
+    m_smart->unlockRevision(reg.second.revision);
+    reg.second.revision = -1;
+    m_register_anchors[reg.first].capture(m_document, cursors, ranges);
+  }
+
+  // the reload removes all the text, the idle cursors are anchored too
+  wakeCursors();
+  if (m_cursors.empty() && m_ranges.empty()) {
+    return ;
+  }
+  m_anchors.capture(m_document, cursorPositions(), rangePositions());
+  // the reload empties the MovingRanges, they are reused by
+  // documentReloaded()
+  m_is_moved = true;
+}
+
+void MultiCursorView::documentTextChanged(KTextEditor::Document*)
+{
+  if (isSharedStateOwner() && m_smart->revision() - m_shared->rebased_revision
+    >= SharedState::rebase_interval) {
+    rebaseRevisions();
+  }
+}
+
+void MultiCursorView::rebaseRevisions()
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  const qint64 revision = m_smart->revision();
+  m_shared->rebased_revision = revision;
+  // the lock of the current revision is taken before the old one is released
+  auto rebase = [this, revision](MultiCursorCodec::PackedSet & set) {
+    std::vector<KTextEditor::Cursor> cursors;
+    std::vector<KTextEditor::Range> ranges;
+    MultiCursorCodec::decode(set.cursors, cursors);
+    MultiCursorCodec::decode(set.ranges, ranges);
+    transformPositions(cursors, ranges, set.revision);
+    set.cursors = MultiCursorCodec::encode(cursors);
+    set.ranges = MultiCursorCodec::encode(ranges);
+    set.revision = revision;
+  };
+  for (auto & reg : m_shared->registers) {
+    const qint64 from = reg.second.revision;
+    if (from != -1 && from != revision) {
+      rebase(reg.second);
+      m_smart->lockRevision(revision);
+      m_smart->unlockRevision(from);
+    }
+  }
+  // both parts of a delta share one lock
+  auto rebase_history = [&](std::deque<MultiCursorCodec::PackedDelta> & deltas) {
+    for (auto & d : deltas) {
+      const qint64 from = d.revision();
+      if (from != revision) {
+        rebase(d.added);
+        rebase(d.removed);
+        m_smart->lockRevision(revision);
+        m_smart->unlockRevision(from);
+      }
+    }
+  };
+  rebase_history(m_shared->history.undo);
+  rebase_history(m_shared->history.redo);
+}
+
+void MultiCursorView::documentReloaded(KTextEditor::Document*)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  if (!isSharedStateOwner()) {
+    return ;
+  }
+  for (auto & anchors : m_register_anchors) {
+    std::vector<KTextEditor::Cursor> cursors;
+    std::vector<KTextEditor::Range> ranges;
+    anchors.second.relocate(m_document, cursors, ranges);
+    MultiCursorCodec::PackedSet & reg = m_shared->registers[anchors.first];
+    reg.cursors = MultiCursorCodec::encode(cursors);
+    reg.ranges = MultiCursorCodec::encode(ranges);
+    reg.revision = m_smart->revision();
+    m_smart->lockRevision(reg.revision);
+  }
+  m_register_anchors.clear();
+  m_shared->rebased_revision = m_smart->revision();
+
+  if (m_anchors.isEmpty()) {
+    return ;
+  }
+  m_is_moved = false;
+  std::vector<KTextEditor::Cursor> cursors;
+  std::vector<KTextEditor::Range> ranges;
+  m_anchors.relocate(m_document, cursors, ranges);
+  m_anchors.clear();
+  assignCursors(cursors);
+  assignRanges(ranges);
+  parkCursors();
+}
+
+void MultiCursorView::trackTextInserted(
+  KTextEditor::Document*, const KTextEditor::Range& range)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  m_shared->idle_cursors.textInserted(range);
+}
+
+void MultiCursorView::trackTextRemoved(
+  KTextEditor::Document*, const KTextEditor::Range& range)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  m_shared->idle_cursors.textRemoved(range);
+}
+
+void MultiCursorView::storeRegister()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  const QString & active = m_shared->active_register;
+  bool ok = false;
+  const QString name = KInputDialog::getText(
+    i18n("Store Virtuals Cursors in a Register"), i18n("Register name:")
+  , active.isEmpty() ? QString("a") : active, &ok, m_view);
+  if (!ok || name.isEmpty()) {
+    return ;
+  }
+  storeInRegister(name);
+  m_shared->active_register = name;
+}
+
+void MultiCursorView::switchRegister()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  QStringList names;
+  int current = 0;
+  for (auto & reg : m_shared->registers) {
+    if (reg.first == m_shared->active_register) {
+      current = names.size();
+    }
+    names.append(reg.first);
+  }
+  if (names.isEmpty()) {
+    KMessageBox::information(m_view, i18n("No register."));
+    return ;
+  }
+
+  bool ok = false;
+  const QString name = KInputDialog::getItem(
+    i18n("Switch to a Register"), i18n("Register:")
+  , names, current, false, &ok, m_view);
+  if (!ok) {
+    return ;
+  }
+
+  // the current set goes back to its register
+  if (!m_shared->active_register.isEmpty()
+    && m_shared->active_register != name) {
+    storeInRegister(m_shared->active_register);
+  }
+  m_shared->active_register = name;
+  unpack(m_shared->registers[name]);
+}
+
+void MultiCursorView::removeRegister()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  QStringList names;
+  for (auto & reg : m_shared->registers) {
+    names.append(reg.first);
+  }
+  if (names.isEmpty()) {
+    KMessageBox::information(m_view, i18n("No register."));
+    return ;
+  }
+
+  bool ok = false;
+  const QString name = KInputDialog::getItem(
+    i18n("Remove a Register"), i18n("Register:"), names, 0, false, &ok, m_view);
+  if (!ok) {
+    return ;
+  }
+
+  auto it = m_shared->registers.find(name);
+  m_smart->unlockRevision(it->second.revision);
+  m_shared->registers.erase(it);
+  if (m_shared->active_register == name) {
+    m_shared->active_register.clear();
+  }
+}
+
+void MultiCursorView::importPositions()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  const KUrl url = m_document->url();
+  const QString filename = KFileDialog::getOpenFileName(
+    KUrl(), QString(), m_view, i18n("Import Virtuals Cursors Positions"));
+  if (filename.isEmpty()) {
+    return ;
+  }
+
+  std::vector<KTextEditor::Cursor> cursors;
+  std::vector<KTextEditor::Range> ranges;
+  if (!MultiCursorPositions::read(
+    filename, url.isLocalFile() ? url.toLocalFile() : QString()
+  , cursors, ranges)) {
+    KMessageBox::sorry(m_view, i18n("Cannot read %1.", filename));
+    return ;
+  }
+
+  // positions of an older version of the file are kept in the document
+  normalizePositions(cursors, ranges);
+
+  CursorListDetail::HistoryRecord record(*this);
+  setCursors(cursors);
+  setRanges(ranges);
+}
+
+void MultiCursorView::exportPositions()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  const KUrl url = m_document->url();
+  const QString filename = KFileDialog::getSaveFileName(
+    KUrl(), QString(), m_view, i18n("Export Virtuals Cursors Positions"));
+  if (filename.isEmpty()) {
+    return ;
+  }
+
+  if (!MultiCursorPositions::write(
+    filename, url.isLocalFile() ? url.toLocalFile() : m_document->documentName()
+  , cursorPositions(), rangePositions())) {
+    KMessageBox::sorry(m_view, i18n("Cannot write %1.", filename));
+  }
+}
+
+void MultiCursorView::transformRanges(MultiCursorTransform const & transform)
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  const std::vector<KTextEditor::Range> ranges = rangePositions();
+  std::vector<QString> texts;
+  texts.reserve(ranges.size());
+  for (KTextEditor::Range const & r : ranges) {
+    texts.push_back(m_document->text(r));
+  }
+
+  replaceRanges(ranges, texts, transform.run(texts));
+}
+
+void MultiCursorView::replaceRanges(
+  std::vector<KTextEditor::Range> const & ranges
+, std::vector<QString> const & texts
+, std::vector<std::size_t> const & changed)
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  if (changed.empty()) {
+    return ;
+  }
+
+  CursorListDetail::HistoryRecord record(*this);
+  if (!startEditing(false)) {
+    return ;
+  }
+  for (auto it = changed.rbegin(); it != changed.rend(); ++it) {
+    MULTICURSOR_TRACE("replaceText", "document");
+    m_document->replaceText(ranges[*it], texts[*it]);
+  }
+  endEditing();
+  // an emptied MovingRange is removed, the positions are computed
+  assignRanges(MultiCursorTransform::replacedRanges(ranges, texts));
+}
+
+void MultiCursorView::upperCaseRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  transformRanges(MultiCursorTransform(MultiCursorTransform::Upper));
+}
+
+void MultiCursorView::lowerCaseRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  transformRanges(MultiCursorTransform(MultiCursorTransform::Lower));
+}
+
+void MultiCursorView::titleCaseRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  transformRanges(MultiCursorTransform(MultiCursorTransform::Title));
+}
+
+void MultiCursorView::trimRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  transformRanges(MultiCursorTransform(MultiCursorTransform::Trim));
+}
+
+void MultiCursorView::sortLinesInRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  transformRanges(MultiCursorTransform(MultiCursorTransform::SortLines));
+}
+
+void MultiCursorView::uniqueLinesInRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  transformRanges(MultiCursorTransform(MultiCursorTransform::UniqueLines));
+}
+
+void MultiCursorView::replaceInRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  const QString title = i18n("Replace in Virtuals Selections");
+  bool ok = false;
+  const QString pattern = KInputDialog::getText(
+    title, i18n("Regular expression:"), m_last_pattern, &ok, m_view);
+  if (!ok || pattern.isEmpty()) {
+    return ;
+  }
+  QRegExp regex(pattern);
+  if (!regex.isValid()) {
+    KMessageBox::sorry(m_view, regex.errorString(), title);
+    return ;
+  }
+  m_last_pattern = pattern;
+
+  const QString replacement = KInputDialog::getText(
+    title, i18n("Replacement (\\1 to \\9 for the captures):"), QString(), &ok, m_view);
+  if (!ok) {
+    return ;
+  }
+  transformRanges(MultiCursorTransform(regex, replacement));
+}
+
+/// The values are formatted in one buffer. Each value is then copied for
+/// its insertion because the undo of KatePart keeps the inserted string.
+void MultiCursorView::insertSequence()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  const QString title = i18n("Insert a Sequence on Virtuals Cursors");
+  bool ok = false;
+  const QString spec = KInputDialog::getText(
+    title
+  , i18n("start[:step[:width]] (1, 007, 0xff, a, 2024-01-31):")
+  , m_last_sequence.isEmpty() ? QString("1") : m_last_sequence, &ok, m_view);
+  if (!ok) {
+    return ;
+  }
+  MultiCursorSequence sequence;
+  if (!sequence.parse(spec)) {
+    KMessageBox::sorry(m_view, i18n("Invalid sequence: %1", spec), title);
+    return ;
+  }
+  m_last_sequence = spec;
+
+  QString buffer;
+  std::vector<int> offsets;
+  sequence.format(m_cursors.size(), buffer, offsets);
+
+  if (!startEditing(false)) {
+    return ;
+  }
+  // from the last cursor, the previous positions do not move
+  for (std::size_t i = m_cursors.size(); i != 0; --i) {
+    // owning copy, the undo items of KatePart keep the inserted text
+    insertText(m_cursors[i-1].cursor()
+    , buffer.mid(offsets[i-1], offsets[i] - offsets[i-1]));
+  }
+  endEditing();
+}
+
+/// The n-th cursors of the lines form a group aligned on the largest
+/// column of the group, the groups are aligned from the left.
+void MultiCursorView::alignCursors()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  if (m_cursors.size() < 2) {
+    return ;
+  }
+
+  int tab_width = 8;
+  if (KTextEditor::ConfigInterface * config
+    = qobject_cast<KTextEditor::ConfigInterface*>(m_document)) {
+    const int width = config->configValue("tab-width").toInt();
+    if (width > 0) {
+      tab_width = width;
+    }
+  }
+
+  // cursors of a line are [first, last), the text receives the padding
+  struct Line
+  {
+    std::size_t first;
+    std::size_t last;
+    QString text;
+  };
+  std::vector<Line> lines;
+  std::size_t max_by_line = 0;
+  for (std::size_t i = 0; i < m_cursors.size(); ++i) {
+    const int line = m_cursors[i].line();
+    if (lines.empty() || m_cursors[lines.back().first].line() != line) {
+      lines.push_back(Line{i, i, m_document->line(line)});
+    }
+    max_by_line = qMax(max_by_line, ++lines.back().last - lines.back().first);
+  }
+
+  const std::vector<KTextEditor::Cursor> positions = cursorPositions();
+  // padding inserted before each cursor, cumulated on the line
+  std::vector<int> shifts(m_cursors.size(), 0);
+  std::vector<int> pads(m_cursors.size(), 0);
+  int max_pad = 0;
+  for (std::size_t k = 0; k < max_by_line; ++k) {
+    int target = 0;
+    for (Line const & l : lines) {
+      const std::size_t i = l.first + k;
+      if (i < l.last) {
+        shifts[i] = (k ? shifts[i-1] + pads[i-1] : 0);
+        target = qMax(target, CursorListDetail::visualColumn(
+          l.text, positions[i].column() + shifts[i], tab_width));
+      }
+    }
+    for (Line & l : lines) {
+      const std::size_t i = l.first + k;
+      if (i < l.last) {
+        const int column = positions[i].column() + shifts[i];
+        pads[i] = target
+          - CursorListDetail::visualColumn(l.text, column, tab_width);
+        if (pads[i]) {
+          l.text.insert(column, QString(pads[i], ' '));
+          max_pad = qMax(max_pad, pads[i]);
+        }
+      }
+    }
+  }
+  if (!max_pad) {
+    return ;
+  }
+
+  CursorListDetail::HistoryRecord record(*this);
+  if (!startEditing(false)) {
+    return ;
+  }
+  for (std::size_t i = positions.size(); i != 0; --i) {
+    if (pads[i-1]) {
+      // owning string, the undo items of KatePart keep the inserted text
+      insertText(positions[i-1], QString(pads[i-1], ' '));
+    }
+  }
+  endEditing();
+
+  for (std::size_t i = 0; i < m_cursors.size(); ++i) {
+    m_cursors[i].setCursor(
+      positions[i].line(), positions[i].column() + shifts[i] + pads[i]);
+  }
+}
+
+void MultiCursorView::pipeRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  startPipe(false);
+}
+
+void MultiCursorView::pipeJoinedRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  startPipe(true);
+}
+
+void MultiCursorView::startPipe(bool is_joined)
+{
+  if (m_pipe.pipe) {
+    KMessageBox::information(m_view, i18n("A command is already running."));
+    return ;
+  }
+
+  bool ok = false;
+  const QString command = KInputDialog::getText(
+    i18n("Pipe Through a Command"), i18n("Command:"), m_last_command, &ok, m_view);
+  if (!ok || command.isEmpty()) {
+    return ;
+  }
+  m_last_command = command;
+
+  m_pipe.ranges = rangePositions();
+  m_pipe.revision = m_smart->revision();
+  std::vector<QString> texts;
+  texts.reserve(m_pipe.ranges.size());
+  for (KTextEditor::Range const & r : m_pipe.ranges) {
+    texts.push_back(m_document->text(r));
+  }
+
+  m_pipe.pipe = new MultiCursorPipe(command, std::move(texts), is_joined, this);
+  connect(m_pipe.pipe, SIGNAL(finished(bool)), this, SLOT(pipeFinished(bool)));
+  m_pipe.pipe->start();
+}
+
+void MultiCursorView::pipeFinished(bool ok)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  MultiCursorPipe * pipe = m_pipe.pipe;
+  m_pipe.pipe = nullptr;
+  pipe->deleteLater();
+  const std::vector<KTextEditor::Range> ranges = std::move(m_pipe.ranges);
+  m_pipe.ranges.clear();
+
+  if (!ok) {
+    KMessageBox::sorry(m_view, pipe->errorString(), i18n("Pipe Through a Command"));
+    return ;
+  }
+  if (m_smart->revision() != m_pipe.revision) {
+    KMessageBox::sorry(m_view, i18n("The document changed while the command was running."));
+    return ;
+  }
+
+  std::vector<QString> const & texts = pipe->outputs();
+  std::vector<std::size_t> changed;
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    if (m_document->text(ranges[i]) != texts[i]) {
+      changed.push_back(i);
+    }
+  }
+  replaceRanges(ranges, texts, changed);
+}
+
+namespace {
+const struct {
+  const char * action;
+  MultiCursorMacro::Operation op;
+} macro_actions[] = {
+  {"backspace", MultiCursorMacro::Backspace},
+  {"delete_next_character", MultiCursorMacro::DeleteNext},
+  {"delete_word_left", MultiCursorMacro::DeleteWordLeft},
+  {"delete_word_right", MultiCursorMacro::DeleteWordRight},
+  {"move_line_up", MultiCursorMacro::Up},
+  {"move_line_down", MultiCursorMacro::Down},
+  /* "cusor" is ok */
+  {"move_cusor_left", MultiCursorMacro::Left},
+  {"move_cursor_right", MultiCursorMacro::Right},
+  {"beginning_of_line", MultiCursorMacro::LineStart},
+  {"end_of_line", MultiCursorMacro::LineEnd},
+  {"word_left", MultiCursorMacro::WordLeft},
+  {"word_right", MultiCursorMacro::WordRight},
+};
+}
+
+/// The typing and the KatePart actions of the real cursor are recorded, the
+/// mouse moves are not.
+void MultiCursorView::recordMacro(bool active)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  KActionCollection * collec = m_view->actionCollection();
+  if (active) {
+    m_macro.clear();
+    if (!m_macro_mapper) {
+      m_macro_mapper = new QSignalMapper(this);
+      connect(m_macro_mapper, SIGNAL(mapped(int)), this, SLOT(recordMacroStep(int)));
+    }
+    for (auto & entry : macro_actions) {
+      if (QAction * action = collec->action(entry.action)) {
+        m_macro_mapper->setMapping(action, entry.op);
+        connect(action, SIGNAL(triggered(bool)), m_macro_mapper, SLOT(map()));
+      }
+    }
+    connect(m_document, SIGNAL(textInserted(KTextEditor::Document*,KTextEditor::Range)),
+            this, SLOT(recordMacroInsertion(KTextEditor::Document*,KTextEditor::Range)));
+  }
+  else if (m_macro_mapper) {
+    for (auto & entry : macro_actions) {
+      if (QAction * action = collec->action(entry.action)) {
+        disconnect(action, SIGNAL(triggered(bool)), m_macro_mapper, SLOT(map()));
+        m_macro_mapper->removeMappings(action);
+      }
+    }
+    disconnect(m_document, SIGNAL(textInserted(KTextEditor::Document*,KTextEditor::Range)),
+               this, SLOT(recordMacroInsertion(KTextEditor::Document*,KTextEditor::Range)));
+  }
+}
+
+void MultiCursorView::recordMacroStep(int op)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  m_macro.record(MultiCursorMacro::Operation(op));
+}
+
+void MultiCursorView::recordMacroInsertion(
+  KTextEditor::Document * doc, const KTextEditor::Range & range
+) {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  // the insertions on the virtual cursors are in an exclusive edition
+  if (!m_has_exclusive_edit && isEditingView()) {
+    m_macro.record(MultiCursorMacro::Insert, doc->text(range));
+  }
+}
+
+/// The steps are played on a copy of the lines around the cursors, then
+/// the differences are applied in one transaction (one undo step).
+void MultiCursorView::replayMacro()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  if (m_macro.isEmpty() || m_cursors.empty()) {
+    return ;
+  }
+  const MultiCursorMacro::Script script
+    = m_macro.compile(m_document, cursorPositions());
+
+  CursorListDetail::HistoryRecord record(*this);
+  if (!startEditing(false)) {
+    return ;
+  }
+  for (auto it = script.edits.rbegin(); it != script.edits.rend(); ++it) {
+    MULTICURSOR_TRACE("replaceText", "document");
+    m_document->replaceText(it->range, it->text);
+  }
+  endEditing();
+  assignCursors(script.cursors);
+}
+
+void MultiCursorView::setRanges(std::vector<KTextEditor::Range> const & ranges)
+{
+  MULTICURSOR_TRACE_FUNCTION("bulk");
+  if (ranges.empty()) {
+    return ;
+  }
+
+  const bool was_empty = m_ranges.empty();
+
+  // union of the two sorted sequences
+  std::vector<KTextEditor::Range> merged;
+  merged.reserve(m_ranges.size() + ranges.size());
+  auto push = [&merged](KTextEditor::Range const & r) {
+    if (!merged.empty() && r.start() <= merged.back().end()) {
+      if (merged.back().end() < r.end()) {
+        merged.back().setRange(merged.back().start(), r.end());
+      }
+    }
+    else {
+      merged.push_back(r);
+    }
+  };
+  auto first = m_ranges.begin();
+  auto last = m_ranges.end();
+  auto it = ranges.begin();
+  auto end = ranges.end();
+  while (first != last && it != end) {
+    if (first->start() < it->start()) {
+      push((first++)->toRange());
+    }
+    else {
+      push(*it++);
+    }
+  }
+  for (; first != last; ++first) {
+    push(first->toRange());
+  }
+  for (; it != end; ++it) {
+    push(*it);
+  }
+
+  // the MovingRanges are reused in order
+  const std::size_t reused = qMin(m_ranges.size(), merged.size());
+  for (std::size_t i = 0; i < reused; ++i) {
+    m_ranges[i].setRange(merged[i]);
+  }
+  if (m_ranges.size() > merged.size()) {
+    m_ranges.erase(m_ranges.begin() + merged.size(), m_ranges.end());
+  }
+  else {
+    m_ranges.reserve(merged.size());
+    for (std::size_t i = reused; i < merged.size(); ++i) {
+      m_ranges.emplace_back(newMovingRange(merged[i]));
+    }
+  }
+
+  updateSizePeak();
+  if (was_empty) {
+    startRanges();
+  }
+}
+
+bool MultiCursorView::searchMatches(
+  const QString& title
+, std::vector<KTextEditor::Range> & matches
+, bool allow_empty)
+{
+  bool ok = false;
+  const QString pattern = KInputDialog::getText(
+    title, i18n("Regular expression:"), m_last_pattern, &ok, m_view);
+  if (!ok || pattern.isEmpty()) {
+    return false;
+  }
+
+  QRegExp regex(pattern);
+  if (!regex.isValid()) {
+    KMessageBox::sorry(m_view, regex.errorString(), title);
+    return false;
+  }
+  m_last_pattern = pattern;
+
+  const KTextEditor::Range range = m_view->selection()
+    ? m_view->selectionRange()
+    : KTextEditor::Range(KTextEditor::Cursor(0, 0), m_document->documentEnd());
+  matches = MultiCursorSearch::findAll(
+    MultiCursorSearch::snapshot(m_document, range), regex, allow_empty);
+  return true;
+}
+
+void MultiCursorView::cursorsFromMatches()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  std::vector<KTextEditor::Range> matches;
+  if (searchMatches(i18n("Set Virtual Cursors at All Matches"), matches, true)) {
+    std::vector<KTextEditor::Cursor> cursors;
+    cursors.reserve(matches.size());
+    for (KTextEditor::Range const & r : matches) {
+      cursors.push_back(r.start());
+    }
+    setCursors(cursors);
+  }
+}
+
+void MultiCursorView::rangesFromMatches()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  std::vector<KTextEditor::Range> matches;
+  if (searchMatches(i18n("Virtual Selections from Matches"), matches, false)) {
+    setRanges(matches);
+  }
+}
+
+KTextEditor::Range MultiCursorView::visibleRange() const
+{
+  KTextEditor::Cursor first = KTextEditor::Cursor::invalid();
+  KTextEditor::Cursor last = KTextEditor::Cursor::invalid();
+  if (auto * iface
+    = qobject_cast<KTextEditor::CoordinatesToCursorInterface*>(m_view)) {
+    const int x = m_view->width() / 2;
+    first = iface->coordinatesToCursor(QPoint(x, 0));
+    last = iface->coordinatesToCursor(QPoint(x, m_view->height() - 1));
+  }
+  if (!first.isValid() || !last.isValid()) {
+    // around the cursor
+    const int line = m_view->cursorPosition().line();
+    first = KTextEditor::Cursor(qMax(0, line - 100), 0);
+    last = KTextEditor::Cursor(line + 100, 0);
+  }
+  const int last_line = qMin(last.line(), m_document->lines() - 1);
+  return KTextEditor::Range(
+    first.line(), 0, last_line, m_document->lineLength(last_line));
+}
+
+int MultiCursorView::pageLines() const
+{
+  const KTextEditor::Range range = visibleRange();
+  return qMax(1, range.end().line() - range.start().line());
+}
+
+void MultiCursorView::setPreviewHighlights(
+  std::vector<KTextEditor::Range> const & ranges
+) {
+  // the MovingRanges are reused
+  auto & highlights = m_preview.highlights;
+  if (highlights.size() > ranges.size()) {
+    highlights.resize(ranges.size());
+  }
+  for (std::size_t i = 0; i < highlights.size(); ++i) {
+    highlights[i]->setRange(ranges[i]);
+  }
+  for (std::size_t i = highlights.size(); i < ranges.size(); ++i) {
+    KTextEditor::MovingRange * moving_range = m_smart->newMovingRange(ranges[i]);
+    moving_range->setAttribute(m_selection_attr);
+    moving_range->setView(m_view);
+    highlights.emplace_back(moving_range);
+  }
+}
+
+void MultiCursorView::previewMatches()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  Preview & p = m_preview;
+  if (!p.bar) {
+    p.bar = new MultiCursorPreviewBar(m_view);
+    connect(p.bar, SIGNAL(patternChanged(QString)),
+            this, SLOT(previewPatternChanged(QString)));
+    connect(p.bar, SIGNAL(accepted()), this, SLOT(previewAccepted()));
+    connect(p.bar, SIGNAL(rejected()), this, SLOT(closePreview()));
+    p.watcher = new QFutureWatcher<std::vector<KTextEditor::Range>>(this);
+    connect(p.watcher, SIGNAL(finished()), this, SLOT(previewReady()));
+  }
+  p.bar->popup(m_last_pattern);
+  previewPatternChanged(m_last_pattern);
+}
+
+void MultiCursorView::previewPatternChanged(const QString & pattern)
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  Preview & p = m_preview;
+  p.stamp = p.generation->fetchAndAddOrdered(1) + 1;
+
+  QRegExp regex(pattern);
+  if (pattern.isEmpty() || !regex.isValid()) {
+    setPreviewHighlights(std::vector<KTextEditor::Range>());
+    p.bar->setError(pattern.isEmpty() ? QString() : regex.errorString());
+    return ;
+  }
+
+  if (p.revision != m_smart->revision()) {
+    p.revision = m_smart->revision();
+    p.snapshot = std::make_shared<MultiCursorSearch::Snapshot>(
+      MultiCursorSearch::snapshot(m_document, m_document->documentRange()));
+    p.pattern.clear();
+    p.matches.clear();
+  }
+
+  // the visible lines first, in this thread
+  const std::vector<KTextEditor::Range> visible = MultiCursorSearch::findAll(
+    MultiCursorSearch::snapshot(m_document, visibleRange()), regex, false);
+  setPreviewHighlights(visible);
+  p.bar->setMatchCount(int(visible.size()), -1);
+
+  // then the whole document, the matches of an extended literal pattern
+  // are a subset of the previous ones
+  const MultiCursorSearch::Cancel cancel = {p.generation, p.stamp};
+  QFuture<std::vector<KTextEditor::Range>> future;
+  if (!p.pattern.isEmpty()
+   && pattern.startsWith(p.pattern)
+   && QRegExp::escape(pattern) == pattern
+   && QRegExp::escape(p.pattern) == p.pattern
+   && MultiCursorSearch::isRefinable(p.pattern)) {
+    MultiCursorSearch::Refine refine = {
+      p.snapshot, std::move(p.matches), pattern, cancel
+    };
+    future = QtConcurrent::run(refine);
+  }
+  else {
+    MultiCursorSearch::FindAll find = {p.snapshot, regex, false, cancel};
+    future = QtConcurrent::run(find);
+  }
+  p.pattern.clear();
+  p.matches.clear();
+  p.searched_pattern = pattern;
+  p.watcher->setFuture(future);
+}
+
+void MultiCursorView::previewReady()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  Preview & p = m_preview;
+  if (int(*p.generation) != p.stamp) {
+    return ;
+  }
+  p.matches = p.watcher->result();
+  p.pattern = p.searched_pattern;
+  p.bar->setMatchCount(int(p.highlights.size()), int(p.matches.size()));
+}
+
+void MultiCursorView::previewAccepted()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  Preview & p = m_preview;
+  const QString pattern = p.bar->pattern();
+  const QRegExp regex(pattern);
+  if (pattern.isEmpty() || !regex.isValid()) {
+    return ;
+  }
+
+  std::vector<KTextEditor::Range> matches;
+  if (p.revision == m_smart->revision() && int(*p.generation) == p.stamp) {
+    if (p.pattern == pattern) {
+      matches.swap(p.matches);
+    }
+    else if (p.searched_pattern == pattern) {
+      p.watcher->waitForFinished();
+      matches = p.watcher->result();
+    }
+  }
+  if (matches.empty()) {
+    matches = MultiCursorSearch::findAll(
+      MultiCursorSearch::snapshot(m_document, m_document->documentRange())
+    , regex, false);
+  }
+
+  m_last_pattern = pattern;
+  closePreview();
+  setRanges(matches);
+}
+
+void MultiCursorView::closePreview()
 {
-  auto first = std::find_if(m_cursors.begin(), m_cursors.end()
-  , [](Cursor const & c) { return c.line() > 0; });
-  auto cpfirst = m_cursors.begin();
-  auto end = m_cursors.end();
-  for (; first != end; ++first, ++cpfirst) {
-    const int line = first->line() - 1;
-    const int column = first->column();
-    if (column < first->getKeepedColumn()) {
-      const int line_len = m_document->lineLength(line);
-      cpfirst->setCursor(line, qMin(line_len, first->getKeepedColumn()));
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  Preview & p = m_preview;
+  p.generation->fetchAndAddOrdered(1);
+  setPreviewHighlights(std::vector<KTextEditor::Range>());
+  p.revision = -1;
+  p.snapshot.reset();
+  p.pattern.clear();
+  std::vector<KTextEditor::Range>().swap(p.matches);
+  p.bar->hide();
+  m_view->setFocus();
+}
+
+bool MultiCursorView::startOccurrences()
+{
+  OccurrenceIndex & occ = m_occurrences;
+
+  if (m_occurrences_watcher && m_occurrences_watcher->isRunning()) {
+    return false;
+  }
+
+  QString needle;
+  KTextEditor::Cursor origin;
+  int offset = 0;
+  const bool is_range = m_view->selection();
+  if (is_range) {
+    const KTextEditor::Range range = m_view->selectionRange();
+    if (!range.onSingleLine()) {
+      occ.pending.clear();
+      return false;
     }
-    else {
-      cpfirst->setCursorAndKeepColumn(line, column);
+    needle = m_view->selectionText();
+    origin = range.start();
+  }
+  else {
+    const KTextEditor::Cursor cursor = m_view->cursorPosition();
+    const QString line = m_document->line(cursor.line());
+    int start = qMin(cursor.column(), line.size());
+    int end = start;
+    while (start > 0 && line[start-1].isLetterOrNumber()) {
+      --start;
     }
+    while (end < line.size() && line[end].isLetterOrNumber()) {
+      ++end;
+    }
+    needle = line.mid(start, end - start);
+    origin = KTextEditor::Cursor(cursor.line(), start);
+    offset = cursor.column() - start;
   }
-  m_cursors.erase(std::unique(m_cursors.begin(), cpfirst), end);
-  checkCursors();
+
+  if (needle.isEmpty()) {
+    occ.pending.clear();
+    return false;
+  }
+
+  if (occ.is_ready
+   && occ.needle == needle
+   && occ.is_range == is_range
+   && occ.revision == m_smart->revision()) {
+    return true;
+  }
+
+  occ.needle = needle;
+  occ.is_range = is_range;
+  occ.offset = offset;
+  occ.origin = origin;
+  occ.revision = m_smart->revision();
+  occ.is_ready = false;
+  occ.ranges.clear();
+  occ.history.clear();
+
+  const QString escaped = QRegExp::escape(needle);
+  MultiCursorSearch::FindAll find = {
+    std::make_shared<MultiCursorSearch::Snapshot>(
+      MultiCursorSearch::snapshot(m_document, m_document->documentRange()))
+  , QRegExp(is_range ? escaped : "\\b" + escaped + "\\b")
+  , false
+  };
+  if (!m_occurrences_watcher) {
+    m_occurrences_watcher
+      = new QFutureWatcher<std::vector<KTextEditor::Range>>(this);
+    connect(m_occurrences_watcher, SIGNAL(finished()),
+            this, SLOT(occurrencesReady()));
+  }
+  m_occurrences_watcher->setFuture(QtConcurrent::run(find));
+  return false;
 }
 
-void MultiCursorView::moveCursorToDown()
+void MultiCursorView::occurrencesReady()
 {
-  auto first = m_cursors.begin();
-  auto end = m_cursors.end();
-  const int lmax = m_document->lines() - 1;
-  for (; first != end; ++first) {
-    if (lmax < first->line()) {
-      break;
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  OccurrenceIndex & occ = m_occurrences;
+
+  // edited during the search
+  if (occ.revision != m_smart->revision()) {
+    if (startOccurrences()) {
+      processOccurrences();
     }
-    const int column = first->column();
-    const int line = first->line() + 1;
-    if (column < first->getKeepedColumn()) {
-      const int line_len = m_document->lineLength(line);
-      first->setCursor(line, qMin(line_len, first->getKeepedColumn()));
+    return ;
+  }
+
+  occ.ranges = m_occurrences_watcher->result();
+  occ.is_ready = true;
+
+  auto it = CursorListDetail::lowerBoundRange(occ.ranges, occ.origin);
+  occ.remaining = occ.ranges.size();
+  occ.origin_index = std::size_t(-1);
+  if (it != occ.ranges.end() && it->start() == occ.origin) {
+    occ.origin_index = std::size_t(it - occ.ranges.begin());
+    --occ.remaining;
+    ++it;
+  }
+  occ.next = (it == occ.ranges.end()) ? 0 : std::size_t(it - occ.ranges.begin());
+
+  processOccurrences();
+}
+
+void MultiCursorView::processOccurrences()
+{
+  OccurrenceIndex & occ = m_occurrences;
+  const std::size_t none = OccurrenceIndex::Step::none;
+  for (OccurrenceIndex::Command command : occ.pending) {
+    OccurrenceIndex::Step step = {none, none};
+    // the occurrence added by the last step is still there
+    if (command == OccurrenceIndex::Skip
+     && !occ.history.empty()
+     && occ.history.back().added != none) {
+      step.skipped = occ.history.back().added;
+      removeOccurrence(occ.ranges[step.skipped]);
     }
-    else {
-      first->setCursorAndKeepColumn(line, column);
+
+    if (occ.remaining) {
+      if (occ.next == occ.origin_index) {
+        occ.next = (occ.next + 1) % occ.ranges.size();
+      }
+      step.added = occ.next;
+      addOccurrence(occ.ranges[occ.next]);
+      occ.next = (occ.next + 1) % occ.ranges.size();
+      --occ.remaining;
+    }
+
+    if (step.added != none || step.skipped != none) {
+      occ.history.push_back(step);
     }
   }
-  m_cursors.erase(std::unique(m_cursors.begin(), first), end);
-  checkCursors();
+  occ.pending.clear();
 }
 
-void MultiCursorView::moveCursorToLeft()
+void MultiCursorView::addOccurrence(KTextEditor::Range const & range)
 {
-  auto first = m_cursors.begin();
-  if (m_cursors.front().line() == 0 && m_cursors.front().column() == 0) {
-    ++first;
+  if (m_occurrences.is_range) {
+    setRange(range, false);
   }
-  CursorListDetail::moveCursor(*this, first
-  , [this](Cursor const & cur) {
-    const int l = cur.line();
-    const int c = cur.column();
-    if (c == 0) {
-      return KTextEditor::Cursor(l-1, m_document->lineLength(l));
+  else {
+    const KTextEditor::Cursor cursor(
+      range.start().line(), range.start().column() + m_occurrences.offset);
+    auto it = lowerBound(m_cursors, cursor);
+    if (it == m_cursors.end() || !(*it == cursor)) {
+      setCursor(cursor);
     }
-    return KTextEditor::Cursor(l, c-1);
-  });
+  }
 }
 
-void MultiCursorView::moveCursorToRight()
+void MultiCursorView::removeOccurrence(KTextEditor::Range const & range)
 {
-  auto first = m_cursors.rbegin();
-  if (m_cursors.back() == m_document->documentEnd()) {
-    ++first;
-  }
-  auto end = m_cursors.rend();
-  if (first != end) {
-    m_cursors.erase(
-      m_cursors.begin()
-    , CursorListDetail::moveCursorImpl(
-        first, end
-      , m_cursors.rbegin()
-      , [this](Cursor const & cur) {
-        const int l = cur.line();
-        const int c = cur.column();
-        if (m_document->lineLength(l) == c) {
-          return KTextEditor::Cursor(l+1, 0);
-        }
-        return KTextEditor::Cursor(l, c+1);
-    }).base());
+  if (m_occurrences.is_range) {
+    auto it = CursorListDetail::lowerBoundEnd(m_ranges, range.end());
+    if (it != m_ranges.end() && it->contains(range)) {
+      removeRange(it, range);
+    }
   }
   else {
-    m_cursors.clear();
-    stopCursors();
+    const KTextEditor::Cursor cursor(
+      range.start().line(), range.start().column() + m_occurrences.offset);
+    auto it = lowerBound(m_cursors, cursor);
+    if (it != m_cursors.end() && *it == cursor) {
+      m_cursors.erase(it);
+      checkCursors();
+    }
   }
 }
 
-void MultiCursorView::moveCursorToBeginningOfLine()
+void MultiCursorView::addNextOccurrence()
 {
-  for (Cursor & c : m_cursors) {
-    c.setCursor(KTextEditor::Cursor(c.line(), 0));
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  m_occurrences.pending.push_back(OccurrenceIndex::Add);
+  if (startOccurrences()) {
+    processOccurrences();
   }
-  uniqueCont(m_cursors);
 }
 
-void MultiCursorView::moveCursorToEndOfLine()
+void MultiCursorView::skipOccurrence()
 {
-  for (Cursor & c : m_cursors) {
-    const int l = c.line();
-    c.setCursor(KTextEditor::Cursor(l, m_document->lineLength(l)));
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  m_occurrences.pending.push_back(OccurrenceIndex::Skip);
+  if (startOccurrences()) {
+    processOccurrences();
   }
-  uniqueCont(m_cursors);
 }
 
-void MultiCursorView::moveCursorToWordLeft()
+void MultiCursorView::undoLastOccurrence()
 {
-  for (Cursor & c : m_cursors) {
-    c.setCursor(CursorListDetail::wordPrev(m_document, c.line(), c.column()));
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  OccurrenceIndex & occ = m_occurrences;
+  if (!occ.is_ready || occ.history.empty()
+   || occ.revision != m_smart->revision()) {
+    return ;
+  }
+  const OccurrenceIndex::Step step = occ.history.back();
+  occ.history.pop_back();
+  // only an added occurrence was counted in remaining
+  if (step.added != OccurrenceIndex::Step::none) {
+    removeOccurrence(occ.ranges[step.added]);
+    occ.next = step.added;
+    ++occ.remaining;
+  }
+  if (step.skipped != OccurrenceIndex::Step::none) {
+    addOccurrence(occ.ranges[step.skipped]);
   }
-  uniqueCont(m_cursors);
 }
 
-void MultiCursorView::moveCursorToWordRight()
+void MultiCursorView::rangesFromCursors()
 {
-  for (Cursor & c : m_cursors) {
-    c.setCursor(CursorListDetail::wordNext(m_document, c.line(), c.column()));
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  // a cursor inside a selection is merged with it
+  std::vector<KTextEditor::Range> ranges;
+  ranges.reserve(m_cursors.size());
+  for (auto & c : m_cursors) {
+    ranges.push_back(KTextEditor::Range(c.cursor(), c.cursor()));
   }
-  uniqueCont(m_cursors);
+  setRanges(ranges);
 }
 
-void MultiCursorView::moveCursorToMatchingBracket()
+void MultiCursorView::cursorsFromRangeStarts()
 {
-  KTextEditor::HighlightInterface *iface
-    = qobject_cast<KTextEditor::HighlightInterface*>(m_document);
-  if (!iface) {
-    iface = &CursorListDetail::fake_highlight();
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  std::vector<KTextEditor::Cursor> cursors;
+  cursors.reserve(m_ranges.size());
+  for (auto & r : m_ranges) {
+    cursors.push_back(r.start());
   }
-  for (Cursor & c : m_cursors) {
-    KTextEditor::Cursor cursor = c.cursor();
-    if (CursorListDetail::matchingBracket(m_document, iface, cursor)) {
-      c.setCursor(cursor);
-    }
+  setCursors(cursors);
+}
+
+void MultiCursorView::cursorsFromRangeEnds()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  std::vector<KTextEditor::Cursor> cursors;
+  cursors.reserve(m_ranges.size());
+  for (auto & r : m_ranges) {
+    cursors.push_back(r.end());
   }
-  uniqueCont(m_cursors);
+  setCursors(cursors);
 }
 
-void MultiCursorView::setCursor(const KTextEditor::Cursor& cursor)
+void MultiCursorView::keepCursorsInRanges()
 {
-  auto it = lowerBound(m_cursors, cursor);
-  if (it != m_cursors.end() && *it == cursor) {
-    m_cursors.erase(it);
-    checkCursors();
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  CursorListDetail::filterCursors(m_cursors, m_ranges, true);
+  checkCursors();
+}
+
+void MultiCursorView::removeCursorsInRanges()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  CursorListDetail::filterCursors(m_cursors, m_ranges, false);
+  checkCursors();
+}
+
+void MultiCursorView::intersectRangesWithSelection()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
+  if (!m_view->selection()) {
+    return ;
   }
-  else {
-    auto moving_cursor = newMovingCursor(cursor);
-    if (m_cursors.empty()) {
-      m_cursors.emplace_back(moving_cursor);
-      startCursors();
+
+  const KTextEditor::Range selection = m_view->selectionRange();
+  auto first = CursorListDetail::lowerBoundEnd(m_ranges, selection.start());
+  auto last = std::upper_bound(first, m_ranges.end(), selection.end()
+  , [](KTextEditor::Cursor const & c, Range const & r) {
+      return c < r.start();
     }
-    else {
-      m_cursors.emplace(it, moving_cursor);
+  );
+  m_ranges.erase(last, m_ranges.end());
+  m_ranges.erase(m_ranges.begin(), first);
+
+  if (!m_ranges.empty() && m_ranges.back().end() > selection.end()) {
+    m_ranges.back().setRange(m_ranges.back().start(), selection.end());
+    if (m_ranges.back().isEmpty()) {
+      m_ranges.pop_back();
     }
   }
-}
-
-void MultiCursorView::rangesFromCursors()
-{
-  for (auto & c : m_cursors) {
-    KTextEditor::Cursor cursor = c.cursor();
-    auto it_start = CursorListDetail::lowerBoundEnd(m_ranges, cursor);
-    if (it_start == m_ranges.end() || it_start->end() < cursor) {
-      KTextEditor::Range range(cursor, cursor);
-      m_ranges.emplace(it_start, newMovingRange(range));
+  if (!m_ranges.empty() && m_ranges.front().start() < selection.start()) {
+    m_ranges.front().setRange(selection.start(), m_ranges.front().end());
+    if (m_ranges.front().isEmpty()) {
+      m_ranges.erase(m_ranges.begin());
     }
   }
+  checkRanges();
 }
 
 void MultiCursorView::selectLineUp()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::selectAlgoLeft(*this
   , [this](int line, int column) {
     return KTextEditor::Cursor(qMax(line - 1, 0), column);
@@ -1168,6 +3536,7 @@ void MultiCursorView::selectLineUp()
 
 void MultiCursorView::selectLineDown()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::selectAlgoRight(*this
   , [this](int line, int column) {
     if (line + 1 < m_document->lines()) {
@@ -1177,12 +3546,43 @@ void MultiCursorView::selectLineDown()
   });
 }
 
+void MultiCursorView::selectPageUp()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
+  const int lines = pageLines();
+  CursorListDetail::selectByLines(*this
+  , m_view->selectionRange().start() == m_view->cursorPosition()
+  , [this, lines](KTextEditor::Cursor const & c) {
+    const int line = qMax(c.line() - lines, 0);
+    return KTextEditor::Cursor(
+      line, qMin(c.column(), lineLength(line)));
+  });
+}
+
+void MultiCursorView::selectPageDown()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
+  const int lines = pageLines();
+  const int last_line = m_document->lines() - 1;
+  CursorListDetail::selectByLines(*this
+  , m_view->selectionRange().end() != m_view->cursorPosition()
+  , [this, lines, last_line](KTextEditor::Cursor const & c) {
+    const int line = qMin(c.line() + lines, last_line);
+    return KTextEditor::Cursor(
+      line, qMin(c.column(), lineLength(line)));
+  });
+}
+
 void MultiCursorView::selectCharRight()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
   const int linemax = m_document->lines();
   CursorListDetail::selectAlgoRight(*this
   , [linemax, this](int line, int column) {
-    return (column + 1 < m_document->lineLength(line))
+    return (column + 1 < lineLength(line))
       ? KTextEditor::Cursor(line, column + 1)
       : ((linemax != line + 1)
         ? KTextEditor::Cursor(line + 1, 0)
@@ -1193,12 +3593,14 @@ void MultiCursorView::selectCharRight()
 
 void MultiCursorView::selectCharLeft()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
   CursorListDetail::selectAlgoLeft(*this
   , [this](int line, int column) {
     return (column != 0)
       ? KTextEditor::Cursor(line, column - 1)
       : ((line != 0)
-        ? KTextEditor::Cursor(line - 1, m_document->lineLength(line - 1))
+        ? KTextEditor::Cursor(line - 1, lineLength(line - 1))
         : KTextEditor::Cursor(line, column)
       );
   });
@@ -1206,32 +3608,40 @@ void MultiCursorView::selectCharLeft()
 
 void MultiCursorView::selectBeginningOfLine()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   m_ranges_temp.swap(m_ranges);
   m_ranges.clear();
   m_ranges.reserve(m_ranges_temp.size());
+  updateSizePeak();
   for (Range & r : m_ranges_temp) {
-    KTextEditor::Cursor c(r.start().line(), 0);
-    setRange(KTextEditor::Range(c, r.end()), false);
+    KTextEditor::Range range(KTextEditor::Cursor(r.start().line(), 0), r.end());
+    r.recycle();
+    setRange(range, false);
   }
   m_ranges_temp.clear();
 }
 
 void MultiCursorView::selectEndOfLine()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::LineLengthScope line_lengths(*this);
   m_ranges_temp.swap(m_ranges);
   m_ranges.clear();
   m_ranges.reserve(m_ranges_temp.size());
+  updateSizePeak();
   for (Range & r : m_ranges_temp) {
     const int line = r.end().line();
-    const int column = m_document->lineLength(line);
-    KTextEditor::Cursor c(line, column);
-    setRange(KTextEditor::Range(r.start(), c), false);
+    const int column = lineLength(line);
+    KTextEditor::Range range(r.start(), KTextEditor::Cursor(line, column));
+    r.recycle();
+    setRange(range, false);
   }
   m_ranges_temp.clear();
 }
 
 void MultiCursorView::selectWordRight()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::selectAlgoRight(*this
   , [this](int line, int column) {
     return CursorListDetail::wordNext(m_document, line, column);
@@ -1240,24 +3650,16 @@ void MultiCursorView::selectWordRight()
 
 void MultiCursorView::selectWordLeft()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::selectAlgoLeft(*this
   , [this](int line, int column) {
     return CursorListDetail::wordPrev(m_document, line, column);
   });
 }
 
-//void MultiCursorView::selectPageUp()
-//{
-//// TODO
-//}
-
-//void MultiCursorView::selectPageDown()
-//{
-//// TODO
-//}
-
 void MultiCursorView::selectMatchingBracket()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   KTextEditor::HighlightInterface *iface
     = qobject_cast<KTextEditor::HighlightInterface*>(m_document);
   if (!iface) {
@@ -1284,6 +3686,7 @@ void MultiCursorView::setRange(
 
   if (it_start == m_ranges.end()) {
     m_ranges.emplace_back(newMovingRange(range));
+    updateSizePeak();
     return ;
   }
 
@@ -1298,6 +3701,7 @@ void MultiCursorView::setRange(
     }
     else {
       m_ranges.emplace(it_start, newMovingRange(range));
+      updateSizePeak();
     }
   }
   else {
@@ -1329,6 +3733,7 @@ void MultiCursorView::removeRange(
     else {
       it->setRange(leftrange.start(), range.start());
       m_ranges.emplace(it+1, newMovingRange(rightrange));
+      updateSizePeak();
     }
   }
   else if (leftrange.isEmpty()) {
@@ -1342,6 +3747,8 @@ void MultiCursorView::removeRange(
 
 void MultiCursorView::setCursor()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
 	if (m_view->selection()) {
 		const KTextEditor::Range& range = m_view->selectionRange();
 		for (int line = range.start().line(); line != range.end().line() + 1; ++line) {
@@ -1394,6 +3801,7 @@ bool MultiCursorView::eventFilter(QObject* obj, QEvent* event)
      && not QApplication::keyboardModifiers()
      && static_cast<QKeyEvent*>(event)->key() == Qt::Key_Escape
      && not m_view->selection()) {
+      CursorListDetail::HistoryRecord record(*this);
       removeAllCursors();
       removeAllRanges();
       return false;
@@ -1404,12 +3812,14 @@ bool MultiCursorView::eventFilter(QObject* obj, QEvent* event)
       if (m_view->selection()) {
         if (m_has_selection_ctrl) {
           // TODO synchronized
+          CursorListDetail::HistoryRecord record(*this);
           setRange(m_view->selectionRange());
           return false;
         }
       }
       else {
         if (m_has_cursor_ctrl) {
+          CursorListDetail::HistoryRecord record(*this);
           setCursor(m_view->cursorPosition());
           return false;
         }
@@ -1425,27 +3835,58 @@ bool MultiCursorView::eventFilter(QObject* obj, QEvent* event)
 
 void MultiCursorView::textInserted(KTextEditor::Document *doc, const KTextEditor::Range &range)
 {
-	if (startEditing()) {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+	if (isEditingView() && startEditing()) {
 		const QString text = doc->text(range);
-    auto it = lowerBound(m_cursors, m_view->cursorPosition());
-    for (auto first = m_cursors.begin(); first != it; ++first) {
-      m_document->insertText(first->cursor(), text);
-    }
-    auto last = m_cursors.end();
-    if (it != last) {
-      if (m_view->cursorPosition() != it->cursor()) {
-        m_document->insertText(it->cursor(), text);
-      }
-      while (++it != last) {
-        m_document->insertText(it->cursor(), text);
-      }
-    }
+    insertOnCursors(text);
 		endEditing();
+    CursorListDetail::broadcast(*this, [&text](MultiCursorView & v) {
+      if (v.startEditing()) {
+        v.insertOnCursors(text);
+        v.endEditing();
+      }
+    });
 	}
 }
 
+void MultiCursorView::insertOnCursors(const QString& text)
+{
+  const KTextEditor::Cursor real_cursor = realCursor();
+  auto it = lowerBound(m_cursors, real_cursor);
+  for (auto first = m_cursors.begin(); first != it; ++first) {
+    insertText(first->cursor(), text);
+  }
+  auto last = m_cursors.end();
+  if (it != last) {
+    if (real_cursor != it->cursor()) {
+      insertText(it->cursor(), text);
+    }
+    while (++it != last) {
+      insertText(it->cursor(), text);
+    }
+  }
+}
+
+KTextEditor::Cursor MultiCursorView::realCursor() const
+{
+  return m_is_remote_edit
+    ? KTextEditor::Cursor::invalid()
+    : m_view->cursorPosition();
+}
+
+void MultiCursorView::setSynchronizedDocuments()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  m_is_synchronized_document = !m_is_synchronized_document;
+  if (MultiCursorPlugin * plugin = MultiCursorPlugin::self()) {
+    plugin->setSynchronizedDocument(this, m_is_synchronized_document);
+  }
+}
+
 void MultiCursorView::removeAllCursors()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
   if (m_view->selection()) {
     const KTextEditor::Range& range = m_view->selectionRange();
     auto first = lowerBound(m_cursors, range.start());
@@ -1456,12 +3897,15 @@ void MultiCursorView::removeAllCursors()
     }
   } else {
     m_cursors.clear();
+    m_shared->idle_cursors.clear();
     stopCursors();
   }
 }
 
 void MultiCursorView::removeCursorsOnLine()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
   const int line = m_view->cursorPosition().line();
   auto first = lowerBound(m_cursors, line
   , [](Cursor const & c, int line) { return c.line() < line; });
@@ -1478,32 +3922,53 @@ void MultiCursorView::removeCursorsOnLine()
 
 void MultiCursorView::moveToNextCursor()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::moveToNext(
     m_cursors, m_view, CursorListDetail::ProxyCursor());
 }
 
 void MultiCursorView::moveToPreviousCursor()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::moveToPrevious(
     m_cursors, m_view, CursorListDetail::ProxyCursor());
 }
 
 void MultiCursorView::setActiveCursor()
 {
-	if (m_is_active) {
-		m_is_active = false;
-		disconnectCursors();
+  MULTICURSOR_TRACE_FUNCTION("slot");
+	m_is_active = !m_is_active;
+	// the state is shared by the views of the document
+	for (MultiCursorView * view : m_shared->views) {
+		if (view->m_has_actions) {
+			view->actionCollection()->action("active_multicursor")
+			  ->setChecked(m_is_active);
+		}
+	}
+	if (!m_is_active) {
+		for (MultiCursorView * view : m_shared->views) {
+			view->disconnectCursors();
+		}
+		parkCursors();
 	} else {
-		m_is_active = true;
-		connectCursors();
+		// startCursors() connects the views when the list is empty
+		const bool is_started
+		  = m_cursors.empty() && !m_shared->idle_cursors.isEmpty();
+		wakeCursors();
+		if (!is_started) {
+			for (MultiCursorView * view : m_shared->views) {
+				view->connectCursors();
+			}
+		}
 	}
 }
 
 void MultiCursorView::clearRanges()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   if (startEditing(false)) {
     std::for_each(m_ranges.rbegin(), m_ranges.rend()
-    , [this](Range const & r){ m_document->removeText(r.toRange()); });
+    , [this](Range const & r){ removeText(r.toRange()); });
     removeAllRanges();
     endEditing();
   }
@@ -1511,6 +3976,7 @@ void MultiCursorView::clearRanges()
 
 void MultiCursorView::copyRanges()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   int l = m_ranges.front().end().line();
   QString s(m_document->text(m_ranges.front().toRange()));
   std::for_each(m_ranges.cbegin()+1, m_ranges.cend(), [&](Range const & r) {
@@ -1527,12 +3993,14 @@ void MultiCursorView::copyRanges()
 
 void MultiCursorView::cutRanges()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   copyRanges();
   clearRanges();
 }
 
 void MultiCursorView::pasteRanges()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   if (startEditing(false)) {
     const QString text = QApplication::clipboard()->text();
     std::for_each(m_ranges.rbegin(), m_ranges.rend()
@@ -1541,8 +4009,8 @@ void MultiCursorView::pasteRanges()
         return ;
       }
       KTextEditor::Range range = r.toRange();
-      m_document->insertText(r.end(), text);
-      m_document->removeText(range);
+      insertText(r.end(), text);
+      removeText(range);
     });
     endEditing();
   }
@@ -1550,6 +4018,8 @@ void MultiCursorView::pasteRanges()
 
 void MultiCursorView::setRange()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
   if (m_view->selection()) {
     const KTextEditor::Range & range = m_view->selectionRange();
 
@@ -1613,6 +4083,7 @@ void MultiCursorView::setRange()
 
 void MultiCursorView::copyLinesWithCursor()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   int l = -1;
   QString s;
   for(Cursor const & c : m_cursors) {
@@ -1628,6 +4099,7 @@ void MultiCursorView::copyLinesWithCursor()
 
 void MultiCursorView::cutLinesWithCursor()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   copyLinesWithCursor();
   if (startEditing(false)) {
     stopCursors();
@@ -1635,11 +4107,11 @@ void MultiCursorView::cutLinesWithCursor()
     std::for_each(m_cursors.rbegin()+1, m_cursors.rend(), [&](Cursor const & c) {
       const int l2 = c.line();
       if (l != l2) {
-        m_document->removeLine(l);
+        removeLine(l);
         l = l2;
       }
     });
-    m_document->removeLine(l);
+    removeLine(l);
     m_cursors.clear();
     endEditing();
   }
@@ -1647,13 +4119,14 @@ void MultiCursorView::cutLinesWithCursor()
 
 void MultiCursorView::pasteLinesOnCursors()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   if (startEditing(false)) {
     QString s = QApplication::clipboard()->text();
     if (!s.isEmpty()) {
       int i = 0;
       for (Cursor & c : m_cursors) {
         const int i2 = s.indexOf('\n', i);
-        m_document->insertText(c.cursor(), s.mid(i, i2-i));
+        insertText(c.cursor(), s.mid(i, i2-i));
         i = i2 + 1;
         if (i2 == -1) {
           break;
@@ -1666,6 +4139,7 @@ void MultiCursorView::pasteLinesOnCursors()
 
 void MultiCursorView::extendLeftSelection()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   if (m_view->selection()) {
     const KTextEditor::Range & range = m_view->selectionRange();
     auto it = lowerBound(m_cursors, range.start());
@@ -1684,6 +4158,7 @@ void MultiCursorView::extendLeftSelection()
 
 void MultiCursorView::extendRightSelection()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   if (m_view->selection()) {
     const KTextEditor::Range & range = m_view->selectionRange();
     auto it = lowerBound(m_cursors, range.end());
@@ -1702,6 +4177,7 @@ void MultiCursorView::extendRightSelection()
 
 void MultiCursorView::reduceLeftSelection()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   if (m_view->selection()) {
     const KTextEditor::Range & range = m_view->selectionRange();
     auto it = lowerBound(m_cursors, range.start());
@@ -1716,6 +4192,7 @@ void MultiCursorView::reduceLeftSelection()
 
 void MultiCursorView::reduceRightSelection()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   if (m_view->selection()) {
     const KTextEditor::Range & range = m_view->selectionRange();
     auto it = lowerBound(m_cursors, range.end());
@@ -1730,36 +4207,44 @@ void MultiCursorView::reduceRightSelection()
 
 void MultiCursorView::moveToNextEndRange()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::moveToNext(
     m_ranges, m_view, CursorListDetail::RangeEnd());
 }
 
 void MultiCursorView::moveToNextStartRange()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::moveToNext(
     m_ranges, m_view, CursorListDetail::RangeStart());
 }
 
 void MultiCursorView::moveToPreviousEndRange()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::moveToPrevious(
     m_ranges, m_view, CursorListDetail::RangeEnd());
 }
 
 void MultiCursorView::moveToPreviousStartRange()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
   CursorListDetail::moveToPrevious(
     m_ranges, m_view, CursorListDetail::RangeStart());
 }
 
 void MultiCursorView::removeAllRanges()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
   m_ranges.clear();
   stopRanges();
 }
 
 void MultiCursorView::removeRangesOnline()
 {
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  CursorListDetail::HistoryRecord record(*this);
   const int line = m_view->cursorPosition().line();
   auto it_start = lowerBound(m_ranges, line
   , [](Range const & r, int l){
@@ -1768,14 +4253,15 @@ void MultiCursorView::removeRangesOnline()
   );
   if (it_start != m_ranges.end()) {
     if (it_start->start().line() < line && it_start->end().line() > line) {
-      auto moving_range = newMovingRange(KTextEditor::Range(
+      Range moving_range = newMovingRange(KTextEditor::Range(
         KTextEditor::Cursor(line+1, 0), it_start->end()
       ));
       it_start->setRange(
         it_start->start(),
         KTextEditor::Cursor(line-1, m_document->lineLength(line-1))
       );
-      m_ranges.emplace(it_start+1, moving_range);
+      m_ranges.insert(it_start+1, std::move(moving_range));
+      updateSizePeak();
     }
     else if (it_start->end().line() > line) {
       it_start->setRange(
@@ -1817,41 +4303,265 @@ void MultiCursorView::removeRangesOnline()
   }
 }
 
+bool MultiCursorView::canEdit(bool check_active) const
+{
+  return (!check_active || m_is_active) && !m_has_exclusive_edit;
+}
+
 bool MultiCursorView::startEditing(bool check_active)
 {
-  if ((check_active && !m_is_active)
-   || m_has_exclusive_edit
-   || !m_document->startEditing()) {
+  if (!canEdit(check_active) || !m_document->startEditing()) {
     return false;
   }
+  // the tracer can be turned on or off before endEditing()
+  m_is_editing_traced = MultiCursorTracer::isEnabled();
+  if (m_is_editing_traced) {
+    MultiCursorTracer::begin("editing", "edit");
+  }
   return m_has_exclusive_edit = true;
 }
 
 bool MultiCursorView::endEditing()
 {
   m_has_exclusive_edit = false;
-  return m_document->endEditing();
+  const bool ret = m_document->endEditing();
+  // otherwise done by the HistoryRecord of the action
+  if (!m_shared->history.depth) {
+    updateMemoryPeak();
+  }
+  if (m_is_editing_traced) {
+    m_is_editing_traced = false;
+    MultiCursorTracer::end("editing", "edit");
+  }
+  return ret;
+}
+
+bool MultiCursorView::insertText(
+  const KTextEditor::Cursor& cursor, const QString& text)
+{
+  MULTICURSOR_TRACE("insertText", "document");
+  const bool ret = m_document->insertText(cursor, text);
+  if (ret && m_line_lengths.depth) {
+    // the following lines are shifted
+    if (text.contains('\n')) {
+      m_line_lengths.line = -1;
+    }
+    else if (m_line_lengths.line == cursor.line()) {
+      // a column past the end of line is filled by the document
+      m_line_lengths.length
+        = qMax(m_line_lengths.length, cursor.column()) + text.size();
+    }
+  }
+  return ret;
+}
+
+bool MultiCursorView::removeText(const KTextEditor::Range& range)
+{
+  MULTICURSOR_TRACE("removeText", "document");
+  const bool ret = m_document->removeText(range);
+  if (ret && m_line_lengths.depth) {
+    int & length = m_line_lengths.length;
+    if (!range.onSingleLine()) {
+      m_line_lengths.line = -1;
+    }
+    else if (m_line_lengths.line == range.start().line()) {
+      length -= qMin(range.end().column(), length)
+              - qMin(range.start().column(), length);
+    }
+  }
+  return ret;
+}
+
+bool MultiCursorView::removeLine(int line)
+{
+  MULTICURSOR_TRACE("removeLine", "document");
+  m_line_lengths.line = -1;
+  return m_document->removeLine(line);
+}
+
+int MultiCursorView::lineLength(int line) const
+{
+  if (!m_line_lengths.depth) {
+    return m_document->lineLength(line);
+  }
+  if (m_line_lengths.line == line) {
+    ++m_line_lengths.hits;
+    return m_line_lengths.length;
+  }
+  ++m_line_lengths.misses;
+  m_line_lengths.line = line;
+  m_line_lengths.length = m_document->lineLength(line);
+  return m_line_lengths.length;
+}
+
+void MultiCursorView::MemoryUsage::merge(MemoryUsage const & other)
+{
+  cursors += other.cursors;
+  ranges += other.ranges;
+  cursors_capacity += other.cursors_capacity;
+  ranges_capacity += other.ranges_capacity;
+  ranges_temp_capacity += other.ranges_temp_capacity;
+  moving_ranges_bytes += other.moving_ranges_bytes;
+  buffers_bytes += other.buffers_bytes;
+  spare_ranges += other.spare_ranges;
+  created_ranges += other.created_ranges;
+  reused_ranges += other.reused_ranges;
+  retained_revisions += other.retained_revisions;
+}
+
+void MultiCursorView::MemoryUsage::maximize(MemoryUsage const & other)
+{
+  cursors = qMax(cursors, other.cursors);
+  ranges = qMax(ranges, other.ranges);
+  cursors_capacity = qMax(cursors_capacity, other.cursors_capacity);
+  ranges_capacity = qMax(ranges_capacity, other.ranges_capacity);
+  ranges_temp_capacity = qMax(ranges_temp_capacity, other.ranges_temp_capacity);
+  moving_ranges_bytes = qMax(moving_ranges_bytes, other.moving_ranges_bytes);
+  buffers_bytes = qMax(buffers_bytes, other.buffers_bytes);
+  spare_ranges = qMax(spare_ranges, other.spare_ranges);
+  created_ranges = qMax(created_ranges, other.created_ranges);
+  reused_ranges = qMax(reused_ranges, other.reused_ranges);
+  retained_revisions = qMax(retained_revisions, other.retained_revisions);
+}
+
+MultiCursorView::MemoryUsage MultiCursorView::memoryUsage() const
+{
+  MemoryUsage usage;
+  usage.cursors = m_cursors.size();
+  usage.ranges = m_ranges.size();
+  usage.cursors_capacity = m_cursors.capacity();
+  usage.ranges_capacity = m_ranges.capacity();
+  usage.ranges_temp_capacity = m_ranges_temp.capacity();
+  const MultiCursorRangePool & pool = m_shared->pool;
+  usage.spare_ranges = pool.spares();
+  usage.created_ranges = pool.counters().created;
+  usage.reused_ranges = pool.counters().reused;
+  usage.moving_ranges_bytes = estimated_moving_range_size
+    * (m_cursors.size() + m_ranges.size() + m_ranges_temp.size()
+      + pool.spares());
+  usage.buffers_bytes = sizeof(*this) + sizeof(SharedState)
+    + (m_cursors.capacity() + m_shared->cursors_temp.capacity())
+      * sizeof(Cursor)
+    + (m_ranges.capacity() + m_ranges_temp.capacity()) * sizeof(Range)
+    + m_shared->idle_cursors.bytes();
+  qint64 oldest_revision = m_smart->revision();
+  for (auto & reg : m_shared->registers) {
+    usage.buffers_bytes += reg.second.bytes();
+    if (reg.second.revision != -1) {
+      oldest_revision = qMin(oldest_revision, reg.second.revision);
+    }
+  }
+  for (auto & d : m_shared->history.undo) {
+    usage.buffers_bytes += d.bytes();
+    oldest_revision = qMin(oldest_revision, d.revision());
+  }
+  for (auto & d : m_shared->history.redo) {
+    usage.buffers_bytes += d.bytes();
+    oldest_revision = qMin(oldest_revision, d.revision());
+  }
+  usage.retained_revisions = std::size_t(m_smart->revision() - oldest_revision);
+  return usage;
+}
+
+void MultiCursorView::updateSizePeak()
+{
+  MemoryUsage & peak = m_shared->memory_peak;
+  const MultiCursorRangePool & pool = m_shared->pool;
+  peak.cursors = qMax(peak.cursors, m_cursors.size());
+  peak.ranges = qMax(peak.ranges, m_ranges.size());
+  peak.cursors_capacity = qMax(peak.cursors_capacity, m_cursors.capacity());
+  peak.ranges_capacity = qMax(peak.ranges_capacity, m_ranges.capacity());
+  peak.ranges_temp_capacity
+    = qMax(peak.ranges_temp_capacity, m_ranges_temp.capacity());
+  peak.spare_ranges = qMax(peak.spare_ranges, pool.spares());
+  peak.moving_ranges_bytes = qMax(peak.moving_ranges_bytes
+  , estimated_moving_range_size
+    * (m_cursors.size() + m_ranges.size() + m_ranges_temp.size()
+      + pool.spares()));
+}
+
+void MultiCursorView::updateMemoryPeak()
+{
+  m_shared->memory_peak.maximize(memoryUsage());
+  if (MultiCursorPlugin * plugin = MultiCursorPlugin::self()) {
+    plugin->updateMemoryPeak();
+  }
+  traceRangePool();
+}
+
+void MultiCursorView::traceRangePool()
+{
+  // MovingRanges allocated by the action
+  MultiCursorRangePool::Counters const & counters = m_shared->pool.counters();
+  MultiCursorRangePool::Counters & traced = m_shared->traced_pool;
+  const qint64 created = counters.created - traced.created;
+  const qint64 reused = counters.reused - traced.reused;
+  const qint64 deleted = counters.deleted - traced.deleted;
+  traced = counters;
+  if (MultiCursorTracer::isEnabled() && (created || reused || deleted)) {
+    MultiCursorTracer::counter("movingRangeCreated", "pool", created);
+    MultiCursorTracer::counter("movingRangeReused", "pool", reused);
+    MultiCursorTracer::counter("movingRangeDeleted", "pool", deleted);
+  }
+}
+
+MultiCursorView::MemoryReport MultiCursorView::memoryReport() const
+{
+  MemoryReport report;
+  report.current = memoryUsage();
+  report.peak = m_shared->memory_peak;
+  report.peak.maximize(report.current);
+  return report;
+}
+
+void MultiCursorView::showMemoryUsage()
+{
+  MULTICURSOR_TRACE_FUNCTION("slot");
+  KLocale * locale = KGlobal::locale();
+  auto format = [locale](MemoryReport const & report) {
+    return i18n(
+      "%1 cursors (capacity: %2), %3 selections (capacity: %4, temporary: %5)"
+      "<br/>MovingRanges: %6, buffers: %7, total: %8 (peak: %9)"
+    , report.current.cursors, report.current.cursors_capacity
+    , report.current.ranges, report.current.ranges_capacity
+    , report.current.ranges_temp_capacity
+    , locale->formatByteSize(report.current.moving_ranges_bytes)
+    , locale->formatByteSize(report.current.buffers_bytes)
+    , locale->formatByteSize(report.current.bytes())
+    , locale->formatByteSize(report.peak.bytes()))
+    + i18n("<br/>MovingRanges created: %1, reused: %2, spare: %3"
+    , report.current.created_ranges, report.current.reused_ranges
+    , report.current.spare_ranges)
+    + i18n("<br/>Revisions kept by the registers and the history: %1"
+    , report.current.retained_revisions);
+  };
+
+  MultiCursorPlugin * plugin = MultiCursorPlugin::self();
+  KMessageBox::information(m_view, i18n(
+    "<b>This view</b><br/>%1<br/><br/><b>All views (%2)</b><br/>%3"
+  , format(memoryReport())
+  , plugin ? plugin->viewCount() : 1
+  , format(plugin ? plugin->memoryReport() : memoryReport())
+  ), i18n("Memory Usage of Virtuals Cursors"));
 }
 
-KTextEditor::MovingRange* MultiCursorView::newMovingCursor(
+MultiCursorView::Cursor MultiCursorView::newMovingCursor(
   const KTextEditor::Cursor& cursor) const
 {
-  KTextEditor::MovingRange * moving_range = m_smart->newMovingRange(
-    KTextEditor::Range(cursor, cursor.line(), cursor.column() + 1));
+  KTextEditor::MovingRange * moving_range = m_shared->pool.take(m_smart
+  , KTextEditor::Range(cursor, cursor.line(), cursor.column() + 1));
   moving_range->setAttribute(m_cursor_attr);
-  moving_range->setFeedback(
-    const_cast<InvalidedCursor*>(&m_invalided_cursor));
-  return moving_range;
+  moving_range->setFeedback(&m_shared->invalided_cursor);
+  return Cursor(moving_range, m_shared->pool);
 }
 
-KTextEditor::MovingRange* MultiCursorView::newMovingRange(
+MultiCursorView::Range MultiCursorView::newMovingRange(
   const KTextEditor::Range& range) const
 {
-  KTextEditor::MovingRange * moving_range = m_smart->newMovingRange(range);
+  KTextEditor::MovingRange * moving_range = m_shared->pool.take(m_smart, range);
   moving_range->setAttribute(m_selection_attr);
-  moving_range->setFeedback(
-    const_cast<InvalidedRange*>(&m_invalided_range));
-  return moving_range;
+  moving_range->setFeedback(&m_shared->invalided_range);
+  return Range(moving_range, m_shared->pool);
 }
 
 #include "multicursorview.moc"
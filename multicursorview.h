@@ -19,9 +19,21 @@
 #define MULTICURSOR_VIEW_H
 
 #include <vector>
+#include <deque>
+#include <map>
 #include <memory>
+#include <utility>
 
 #include <QObject>
+#include <QString>
+#include <QFutureWatcher>
+
+#include "multicursorsearch.h"
+#include "multicursorcodec.h"
+#include "multicursoranchors.h"
+#include "multicursormacro.h"
+#include "multicursorrangepool.h"
+#include "multicursortracker.h"
 
 #include <KXMLGUIClient>
 #include <KTextEditor/Attribute>
@@ -37,6 +49,10 @@ namespace KTextEditor
 }
 
 class MultiCursorView;
+class MultiCursorPreviewBar;
+class MultiCursorTransform;
+class MultiCursorPipe;
+class QSignalMapper;
 
 
 class MultiCursorView
@@ -47,17 +63,87 @@ class MultiCursorView
 
   class CursorListDetail;
 public:
+  /// cursors and selections, shared by the views of a same document
+  struct SharedState;
+
   explicit MultiCursorView(
     KTextEditor::View *view
   , KTextEditor::Attribute::Ptr cursor_attr
-  , KTextEditor::Attribute::Ptr selection_attr);
+  , KTextEditor::Attribute::Ptr selection_attr
+  , std::shared_ptr<SharedState> shared = std::shared_ptr<SharedState>());
   ~MultiCursorView();
 
+  KTextEditor::Document * document() const
+  { return m_document; }
+
+  std::shared_ptr<SharedState> sharedState() const
+  { return m_shared; }
+
+  /// first view of the shared state, the one that accounts for its memory
+  bool isSharedStateOwner() const;
+
+  /// Estimated size of a MovingRange in KatePart (range, two cursors, block
+  /// registration)
+  static const std::size_t estimated_moving_range_size = 192;
+
+  struct MemoryUsage
+  {
+    std::size_t cursors = 0;
+    std::size_t ranges = 0;
+    std::size_t cursors_capacity = 0;
+    std::size_t ranges_capacity = 0;
+    std::size_t ranges_temp_capacity = 0;
+    std::size_t moving_ranges_bytes = 0;
+    std::size_t buffers_bytes = 0;
+    /// MovingRanges kept by MultiCursorRangePool
+    std::size_t spare_ranges = 0;
+    /// MovingRanges created and reused since the view opened
+    std::size_t created_ranges = 0;
+    std::size_t reused_ranges = 0;
+    /// edits kept by KatePart since the oldest revision locked by the
+    /// registers or the history
+    std::size_t retained_revisions = 0;
+
+    std::size_t bytes() const
+    { return moving_ranges_bytes + buffers_bytes; }
+
+    void merge(MemoryUsage const & other);
+    void maximize(MemoryUsage const & other);
+  };
+
+  struct MemoryReport
+  {
+    MemoryUsage current;
+    /// peak values since the document (or the plugin) opened
+    MemoryUsage peak;
+  };
+
+  MemoryReport memoryReport() const;
+
+  /// Batch interface used by MultiCursorController. Positions are clamped
+  /// to the document, sorted if needed and applied in one pass (one undo
+  /// step of the virtual cursors).
+  enum BatchMode { BatchAdd, BatchReplace, BatchRemove };
+
+  void applyCursors(std::vector<KTextEditor::Cursor> cursors, BatchMode mode);
+  void applyRanges(std::vector<KTextEditor::Range> ranges, BatchMode mode);
+
+  std::vector<KTextEditor::Cursor> cursorPositions() const;
+  std::vector<KTextEditor::Range> rangePositions() const;
+
+  std::size_t cursorCount() const
+  { return m_cursors.size(); }
+  std::size_t rangeCount() const
+  { return m_ranges.size(); }
+
+  KTextEditor::View * view() const
+  { return m_view; }
+
 private:
   struct Cursor
   {
-    Cursor(KTextEditor::MovingRange * range) noexcept
-    : m_range(range)
+    Cursor(KTextEditor::MovingRange * range, MultiCursorRangePool & pool) noexcept
+    : m_range(range, &pool)
     , m_keep_column(-1)
     {}
 
@@ -85,6 +171,12 @@ private:
       m_keep_column = column;
     }
 
+    void setCursorAndKeepColumn(int line, int column, int keep_column)
+    {
+      setCursor(line, column);
+      m_keep_column = keep_column;
+    }
+
     void resetkeepedColumn()
     { m_keep_column = -1; }
 
@@ -113,14 +205,15 @@ private:
     { m_range->setFeedback(feedback); }
 
   private:
-    std::unique_ptr<KTextEditor::MovingRange> m_range;
+    std::unique_ptr<KTextEditor::MovingRange, MultiCursorRangePool::Deleter>
+      m_range;
     int m_keep_column;
   };
 
   struct Range
   {
-    Range(KTextEditor::MovingRange * range) noexcept
-    : m_range(range)
+    Range(KTextEditor::MovingRange * range, MultiCursorRangePool & pool) noexcept
+    : m_range(range, &pool)
     {}
 
     const KTextEditor::MovingCursor& start() const
@@ -146,14 +239,22 @@ private:
     bool isSame(KTextEditor::MovingRange * other) const
     { return m_range.get() == other; }
 
+    /// gives the MovingRange back to the pool before the range is destroyed,
+    /// for the next newMovingRange()
+    void recycle()
+    { m_range.reset(); }
+
   private:
-    std::unique_ptr<KTextEditor::MovingRange> m_range;
+    std::unique_ptr<KTextEditor::MovingRange, MultiCursorRangePool::Deleter>
+      m_range;
   };
   ///TODO boost::flat_set ?
   typedef std::vector<Cursor> CursorList;
   typedef std::vector<Range> RangeList;
 
 private slots:
+  void initActions();
+
   void exclusiveEditStart(KTextEditor::Document*);
   void exclusiveEditEnd(KTextEditor::Document*);
 
@@ -166,6 +267,11 @@ private slots:
   void deleteNextCharacter();
 
   void setCursor();
+  void cursorsFromMatches();
+  void addNextOccurrence();
+  void skipOccurrence();
+  void undoLastOccurrence();
+  void occurrencesReady();
   void removeCursorsOnLine();
   void removeAllCursors();
 
@@ -175,6 +281,7 @@ private slots:
   void setActiveCursor();
 
   void setSynchronizedCursors();
+  void setSynchronizedDocuments();
 
   void moveCursorToUp();
   void moveCursorToDown();
@@ -186,17 +293,28 @@ private slots:
   void moveCursorToMatchingBracket();
   void moveCursorToWordRight();
   void moveCursorToWordLeft();
+  void moveCursorToPageUp();
+  void moveCursorToPageDown();
 
   void copyLinesWithCursor();
   void cutLinesWithCursor();
   void pasteLinesOnCursors();
 
+  void insertSequence();
+  void alignCursors();
+
   void extendLeftSelection();
   void extendRightSelection();
   void reduceLeftSelection();
   void reduceRightSelection();
 
   void setRange();
+  void rangesFromMatches();
+  void previewMatches();
+  void previewPatternChanged(const QString & pattern);
+  void previewReady();
+  void previewAccepted();
+  void closePreview();
   void removeAllRanges();
   void removeRangesOnline();
   void clearRanges();
@@ -211,9 +329,52 @@ private slots:
   void moveToPreviousEndRange();
 
   void rangesFromCursors();
+  void cursorsFromRangeStarts();
+  void cursorsFromRangeEnds();
+
+  void keepCursorsInRanges();
+  void removeCursorsInRanges();
+  void intersectRangesWithSelection();
 
   void setSynchronizedRanges();
 
+  void showMemoryUsage();
+
+  void undoCursors();
+  void redoCursors();
+
+  void restoreSession();
+
+  void documentAboutToReload(KTextEditor::Document*);
+  void documentReloaded(KTextEditor::Document*);
+  void documentTextChanged(KTextEditor::Document*);
+
+  void trackTextInserted(KTextEditor::Document*, const KTextEditor::Range&);
+  void trackTextRemoved(KTextEditor::Document*, const KTextEditor::Range&);
+
+  void storeRegister();
+  void switchRegister();
+  void removeRegister();
+
+  void importPositions();
+  void exportPositions();
+
+  void upperCaseRanges();
+  void lowerCaseRanges();
+  void titleCaseRanges();
+  void trimRanges();
+  void sortLinesInRanges();
+  void uniqueLinesInRanges();
+  void replaceInRanges();
+  void pipeRanges();
+  void pipeJoinedRanges();
+  void pipeFinished(bool ok);
+
+  void recordMacro(bool active);
+  void recordMacroStep(int op);
+  void recordMacroInsertion(KTextEditor::Document*, const KTextEditor::Range&);
+  void replayMacro();
+
   void selectLineUp();
   void selectLineDown();
   void selectCharRight();
@@ -223,17 +384,84 @@ private slots:
   void selectEndOfLine();
   void selectWordRight();
   void selectWordLeft();
-  //void selectPageUp();
-  //void selectPageDown();
+  void selectPageUp();
+  void selectPageDown();
   void selectMatchingBracket();
 
 private:
+
   bool endEditing();
+  /// startEditing() would succeed
+  bool canEdit(bool check_active = true) const;
   bool startEditing(bool check_active = true);
 
   bool eventFilter(QObject *obj, QEvent *ev);
 
+  bool insertText(const KTextEditor::Cursor& cursor, const QString& text);
+  bool removeText(const KTextEditor::Range& range);
+  bool removeLine(int line);
+
+  /// m_document->lineLength(), cached inside a
+  /// CursorListDetail::LineLengthScope
+  int lineLength(int line) const;
+
+  bool isEditingView() const;
+
+  void insertOnCursors(const QString& text);
+
+  /// invalid cursor when the edition comes from a synchronized document
+  KTextEditor::Cursor realCursor() const;
+
+  /// drops the positions out of the document, sorts and removes duplicates
+  void normalizePositions(
+    std::vector<KTextEditor::Cursor> & cursors
+  , std::vector<KTextEditor::Range> & ranges) const;
+
+  /// replaces all the cursors, the MovingRanges are reused
+  void assignCursors(std::vector<KTextEditor::Cursor> const & cursors);
+  /// replaces all the selections, the MovingRanges are reused
+  void assignRanges(std::vector<KTextEditor::Range> const & ranges);
+
+  MultiCursorCodec::PackedSet pack() const;
+  /// positions are moved from the revision of the set to the current one
+  void unpack(MultiCursorCodec::PackedSet const & set);
+
+  void storeInRegister(const QString & name);
+
+  /// new texts computed in parallel, written back in one transaction
+  void transformRanges(MultiCursorTransform const & transform);
+  /// replaces the texts of \a changed from the last one in one transaction
+  void replaceRanges(
+    std::vector<KTextEditor::Range> const & ranges
+  , std::vector<QString> const & texts
+  , std::vector<std::size_t> const & changed);
+  void startPipe(bool is_joined);
+
+  /// Called by the last view of the shared state. The other views of the
+  /// document keep the positions in the plugin until the last one writes.
+  void saveSession();
+
+  /// moves the registers and the history to the current revision
+  void rebaseRevisions();
+
+  void transformPositions(
+    std::vector<KTextEditor::Cursor> & cursors
+  , std::vector<KTextEditor::Range> & ranges
+  , qint64 revision) const;
+
+  /// Records the changes since the positions (the state before an action,
+  /// at the locked \a revision, unlocked here).
+  void pushHistory(
+    std::vector<KTextEditor::Cursor> cursors
+  , std::vector<KTextEditor::Range> ranges
+  , qint64 revision);
+  void restoreHistory(
+    std::deque<MultiCursorCodec::PackedDelta> & from
+  , std::deque<MultiCursorCodec::PackedDelta> & to);
+
   void setCursor(const KTextEditor::Cursor& cursor);
+  /// adds sorted cursors in one pass, existing cursors are kept
+  void setCursors(std::vector<KTextEditor::Cursor> const & cursors);
 
   void connectCursors();
   void disconnectCursors();
@@ -243,6 +471,14 @@ private:
   void stopCursors();
   void checkCursors();
   void setEnabledCursors(bool);
+  /// the cursors become idle positions when no view is active
+  void parkCursors();
+  void wakeCursors();
+  /// the cursors and the idle cursors, sorted
+  std::vector<KTextEditor::Cursor> allCursorPositions() const;
+  /// the owner of the shared state tracks the edits for the idle cursors
+  void connectIdleCursors();
+  void disconnectIdleCursors();
 
   void connectRanges();
   void disconnectRanges();
@@ -254,12 +490,13 @@ private:
   void setEnabledRanges(bool);
 
   void setRange(const KTextEditor::Range& range, bool remove_if_contains = 1);
+  /// adds ranges sorted by start in one pass, overlapping ranges are merged
+  void setRanges(std::vector<KTextEditor::Range> const & ranges);
   void removeRange(RangeList::iterator, const KTextEditor::Range& range);
 
-  KTextEditor::MovingRange * newMovingCursor(
-    KTextEditor::Cursor const & cursor) const;
-  KTextEditor::MovingRange * newMovingRange(
-    KTextEditor::Range const & range) const;
+  /// the MovingRanges come from SharedState::pool
+  Cursor newMovingCursor(KTextEditor::Cursor const & cursor) const;
+  Range newMovingRange(KTextEditor::Range const & range) const;
 
 public:
   void setActiveCursorCtrlClick(bool active, bool remove_cursor_if_only_click);
@@ -269,48 +506,226 @@ public:
 private:
   void setEventFilter(bool &, bool);
 
+  bool startOccurrences();
+  void processOccurrences();
+  void addOccurrence(KTextEditor::Range const & range);
+  void removeOccurrence(KTextEditor::Range const & range);
+
+  /// lines shown by the view
+  KTextEditor::Range visibleRange() const;
+  /// lines moved by a page up or down
+  int pageLines() const;
+  void setPreviewHighlights(std::vector<KTextEditor::Range> const & ranges);
+
+  bool searchMatches(
+    const QString& title
+  , std::vector<KTextEditor::Range> & matches
+  , bool allow_empty);
+
+  MemoryUsage memoryUsage() const;
+  /// Raises the peak of the sizes of the lists, called for each change of
+  /// the lists. The buffers of the registers and of the history are only
+  /// measured by updateMemoryPeak(), once per action.
+  void updateSizePeak();
+  void updateMemoryPeak();
+  /// writes the pool counters of the last action to the trace
+  void traceRangePool();
+
   class InvalidedCursor : public KTextEditor::MovingRangeFeedback {
-    MultiCursorView & m_cursorview;
+    SharedState & m_state;
 
   public:
-    InvalidedCursor(MultiCursorView & cursorview)
-    : m_cursorview(cursorview)
+    InvalidedCursor(SharedState & state)
+    : m_state(state)
     {}
 
     virtual void rangeEmpty(KTextEditor::MovingRange* range);
   };
 
   class InvalidedRange : public KTextEditor::MovingRangeFeedback {
-    MultiCursorView & m_cursorview;
+    SharedState & m_state;
 
   public:
-    InvalidedRange(MultiCursorView & cursorview)
-    : m_cursorview(cursorview)
+    InvalidedRange(SharedState & state)
+    : m_state(state)
     {}
 
     virtual void rangeEmpty(KTextEditor::MovingRange* range);
   };
 
+public:
+  struct SharedState
+  {
+    SharedState()
+    : has_exclusive_edit(false)
+    , is_moved(false)
+    , is_active(true)
+    , invalided_cursor(*this)
+    , invalided_range(*this)
+    {}
+
+    /// unlocks the revisions of the registers and of the history
+    ~SharedState();
+
+    /// set by the first view, the revisions are locked through it
+    KTextEditor::MovingInterface * smart = nullptr;
+    bool has_exclusive_edit;
+    bool is_moved;
+    /// "Enable Virtuals Cursors", the cursors are parked when it is false
+    bool is_active;
+    InvalidedCursor invalided_cursor;
+    InvalidedRange invalided_range;
+    /// before the lists, destroyed after them
+    MultiCursorRangePool pool;
+    CursorList cursors;
+    RangeList ranges;
+    RangeList ranges_temp;
+    /// buffer of setCursors(), kept between the calls
+    CursorList cursors_temp;
+    std::vector<MultiCursorView*> views;
+    /// cursors of disabled views, without MovingRange
+    MultiCursorTracker idle_cursors;
+    /// their revision is locked to follow the edits
+    std::map<QString, MultiCursorCodec::PackedSet> registers;
+    /// The locked revisions are moved to the current one every
+    /// rebase_interval revisions, KatePart keeps the edits since the oldest.
+    static const qint64 rebase_interval = 1000;
+    qint64 rebased_revision = 0;
+    QString active_register;
+
+    /// Changes of the cursors and the selections, their revision is locked
+    /// to follow the edits.
+    struct History
+    {
+      static const std::size_t max_size = 100;
+
+      std::deque<MultiCursorCodec::PackedDelta> undo;
+      std::deque<MultiCursorCodec::PackedDelta> redo;
+      /// only the outer action is recorded
+      int depth = 0;
+    };
+    History history;
+    /// maximum of memoryUsage() of the views, they all count the shared state
+    MemoryUsage memory_peak;
+    /// pool counters at the end of the last action
+    MultiCursorRangePool::Counters traced_pool;
+  };
+
 private:
   KTextEditor::View *m_view;
   KTextEditor::Document *m_document;
   KTextEditor::MovingInterface *m_smart;
   KTextEditor::Attribute::Ptr m_cursor_attr;
   KTextEditor::Attribute::Ptr m_selection_attr;
-  CursorList m_cursors;
-  RangeList m_ranges;
-  RangeList m_ranges_temp;
-  bool m_has_exclusive_edit;
-  bool m_is_active;
+  std::shared_ptr<SharedState> m_shared;
+  CursorList & m_cursors;
+  RangeList & m_ranges;
+  RangeList & m_ranges_temp;
+  bool & m_has_exclusive_edit;
+  bool & m_is_active;
   bool m_is_synchronized_cursor;
   bool m_is_synchronized_selection;
   bool m_remove_cursor_if_only_click;
   bool m_has_cursor_ctrl;
   bool m_has_selection_ctrl;
   bool m_remove_all_if_esc;
-  bool m_is_moved;
-  InvalidedCursor m_invalided_cursor;
-  InvalidedRange m_invalided_range;
+  bool & m_is_moved;
+  bool m_is_synchronized_document;
+  bool m_is_remote_edit;
+  bool m_has_actions;
+  bool m_has_connected_cursors;
+  /// a begin event of "editing" is waiting for endEditing()
+  bool m_is_editing_traced;
+  QString m_last_pattern;
+
+  /// Occurrences of the word or the selection for addNextOccurrence(),
+  /// built once in background then browsed by index.
+  struct OccurrenceIndex
+  {
+    enum Command { Add, Skip };
+
+    QString needle;
+    bool is_range = false;
+    int offset = 0;
+    qint64 revision = -1;
+    bool is_ready = false;
+    KTextEditor::Cursor origin;
+    std::vector<KTextEditor::Range> ranges;
+    /// next occurrence to add
+    std::size_t next = 0;
+    /// occurrence under the cursor, never added
+    std::size_t origin_index = std::size_t(-1);
+    /// occurrences neither added nor skipped
+    std::size_t remaining = 0;
+    /// a command done, reverted by undoLastOccurrence()
+    struct Step
+    {
+      static const std::size_t none = std::size_t(-1);
+
+      /// occurrence added, none when all were visited
+      std::size_t added;
+      /// occurrence removed by a skip (the last added one), or none
+      std::size_t skipped;
+    };
+    std::vector<Step> history;
+    /// commands received while the index is built
+    std::vector<Command> pending;
+  };
+  OccurrenceIndex m_occurrences;
+  QFutureWatcher<std::vector<KTextEditor::Range>> * m_occurrences_watcher;
+
+  /// Live preview of rangesFromMatches(): the visible lines are searched
+  /// at once, the whole document in background.
+  struct Preview
+  {
+    MultiCursorPreviewBar * bar = nullptr;
+    QFutureWatcher<std::vector<KTextEditor::Range>> * watcher = nullptr;
+    /// incremented by each pattern, drops the stale searches
+    std::shared_ptr<QAtomicInt> generation = std::make_shared<QAtomicInt>(0);
+    int stamp = 0;
+    qint64 revision = -1;
+    MultiCursorSearch::SharedSnapshot snapshot;
+    QString searched_pattern;
+    /// pattern of matches, empty until the search is finished
+    QString pattern;
+    std::vector<KTextEditor::Range> matches;
+    std::vector<std::unique_ptr<KTextEditor::MovingRange>> highlights;
+  };
+  Preview m_preview;
+
+  /// Length of the last line read by the current action (the cursors of a
+  /// line follow each other), patched by insertText() and removeText().
+  struct LineLengthCache
+  {
+    /// -1 when empty
+    int line = -1;
+    int length = 0;
+    /// nested scopes, the cache is off at 0
+    int depth = 0;
+    qint64 hits = 0;
+    qint64 misses = 0;
+  };
+  mutable LineLengthCache m_line_lengths;
+  /// positions during a reload
+  MultiCursorAnchors m_anchors;
+  /// registers during a reload, their revisions do not survive it
+  std::map<QString, MultiCursorAnchors> m_register_anchors;
+  /// steps of the real cursor replayed by replayMacro()
+  MultiCursorMacro m_macro;
+  /// KatePart actions to MultiCursorMacro::Operation while recording
+  QSignalMapper * m_macro_mapper;
+  QString m_last_command;
+  QString m_last_sequence;
+
+  /// selections sent to a command, dropped if the document changes before
+  /// the end
+  struct PipeJob
+  {
+    MultiCursorPipe * pipe = nullptr;
+    qint64 revision = -1;
+    std::vector<KTextEditor::Range> ranges;
+  };
+  PipeJob m_pipe;
 };
 
 #endif
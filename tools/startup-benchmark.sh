@@ -0,0 +1,59 @@
+#!/bin/sh
+# Startup cost of the plugin with N documents: opens them in a new Kate with
+# the trace of the plugin enabled, quits, then sums the "init" spans (the
+# constructor of each view, initActions() of the views really used).
+#
+# usage: tools/startup-benchmark.sh [N] [seconds before quitting]
+#
+# The plugin must be enabled in Kate. The trace options of katerc are
+# restored at the end.
+
+set -e
+
+n=${1:-100}
+delay=${2:-10}
+dir=$(mktemp -d)
+trace="$dir/trace.json"
+group='MultiCursor Plugin'
+
+old_active=$(kreadconfig --file katerc --group "$group" --key active_trace)
+old_file=$(kreadconfig --file katerc --group "$group" --key trace_file)
+restore() {
+  kwriteconfig --file katerc --group "$group" --key active_trace "${old_active:-false}"
+  kwriteconfig --file katerc --group "$group" --key trace_file "$old_file"
+}
+trap restore EXIT
+
+kwriteconfig --file katerc --group "$group" --key active_trace true
+kwriteconfig --file katerc --group "$group" --key trace_file "$trace"
+
+i=0
+while [ $i -lt "$n" ]; do
+  seq 1 200 | sed "s/^/line $i /" > "$dir/doc$i.txt"
+  i=$((i + 1))
+done
+
+start=$(date +%s%N)
+kate -n "$dir"/doc*.txt &
+pid=$!
+sleep "$delay"
+qdbus "org.kde.kate-$pid" /MainApplication quit
+wait $pid || true
+echo "kate: $(( ($(date +%s%N) - start) / 1000000 )) ms with $n documents (including ${delay}s of wait)"
+
+# one event per line, the file is closed by the destruction of the plugin
+python3 - "$trace" <<'PY'
+import re, sys
+spans = {}
+pattern = re.compile(r'"name":"([^"]*)","cat":"init","ph":"X".*"dur":([0-9.]+)')
+for line in open(sys.argv[1]):
+    m = pattern.search(line)
+    if m:
+        spans.setdefault(m.group(1), []).append(float(m.group(2)))
+for name, durations in sorted(spans.items()):
+    print('%-20s count %6d  total %10.3f ms  mean %8.1f us  max %8.1f us' % (
+        name, len(durations), sum(durations) / 1000,
+        sum(durations) / len(durations), max(durations)))
+PY
+
+rm -r "$dir"